@@ -24,6 +24,11 @@ trap cleanup_and_exit EXIT
 gcc *.c -Wall -Wextra -g -std=c89 -pedantic
 ./a
 
+# Single slot event queue, events that don't fit are dropped and counted
+gcc *.c -Wall -Wextra -g -std=c89 -pedantic \
+    -DTBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE=1U
+./a
+
 # Get misra
 MISRA_REPO='https://github.com/furdog/MISRA.git'
 if cd misra; then git pull; cd ..; else git clone "$MISRA_REPO"; fi
@@ -1,6 +1,10 @@
 #include "driver/gpio.h"
 #include "driver/twai.h"
 
+#define TBCM_360_3000_HE_DRI_LOG(v) {printf v;}
+#include "tbcm_360_3000_he_dri.h"
+#include "tbcm_360_3000_he_dri_spsc.h"
+
 /******************************************************************************
  * ESP32 TWAI
  *****************************************************************************/
@@ -26,7 +30,25 @@ struct esp32_twai_frame {
 static twai_handle_t twai_bus_0;
 static twai_handle_t twai_bus_1;
 
-void esp32_twai_init(twai_handle_t *bus)
+/* TWAI has a single acceptance filter in single filter mode.
+ * Standard frame layout: ID at bits 31..21, RTR at bit 20, then data.
+ * TWAI mask bit set to 1 means "don't care" (inverse of driver's mask) */
+twai_filter_config_t esp32_twai_tbcm_filter()
+{
+	struct tbcm_360_3000_he_dri_hw_filter hw;
+	twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+	if (tbcm_360_3000_he_dri_get_hw_filters(&hw, 1) == 1) {
+		f_config.acceptance_code = hw.code << 21;
+		f_config.acceptance_mask = ~((hw.mask << 21) | (1UL << 20));
+		f_config.single_filter   = true;
+	}
+
+	return f_config;
+}
+
+/* Returns false if the driver is not running */
+bool esp32_twai_init(twai_handle_t *bus)
 {
 	esp_err_t code;
 
@@ -43,7 +65,7 @@ void esp32_twai_init(twai_handle_t *bus)
 	twai_general_config_t g_config =
 		TWAI_GENERAL_CONFIG_DEFAULT(bus_tx, bus_rx, TWAI_MODE_NORMAL);
 	twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS  ();
-	twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+	twai_filter_config_t f_config = esp32_twai_tbcm_filter();
 	
 	/* g_config.tx_queue_len = 10; */
 
@@ -55,7 +77,7 @@ void esp32_twai_init(twai_handle_t *bus)
 	} else {
 		printf("Failed to install driver (%s)\n",
 			esp_err_to_name(code));
-		return;
+		return false;
 	}
 	// Start TWAI driver
 	code = twai_start_v2(*bus);
@@ -63,10 +85,12 @@ void esp32_twai_init(twai_handle_t *bus)
 		printf("TWAI driver started\n");
 	} else {
 		printf("Failed to start driver (%s)\n", esp_err_to_name(code));
-		return;
+		return false;
 	}
 
 	twai_reconfigure_alerts_v2(*bus, TWAI_ALERT_BUS_OFF, NULL);
+
+	return true;
 }
 
 /* Call only in bus off state */
@@ -117,7 +141,8 @@ void _esp32_twai_send(twai_handle_t *bus, struct esp32_twai_frame *frame)
 	}
 }
 
-bool _esp32_twai_recv(twai_handle_t *bus, struct esp32_twai_frame *frame)
+bool _esp32_twai_recv(twai_handle_t *bus, struct esp32_twai_frame *frame,
+		      TickType_t ticks_to_wait)
 {
 	bool has_message;
 
@@ -126,7 +151,7 @@ bool _esp32_twai_recv(twai_handle_t *bus, struct esp32_twai_frame *frame)
 						
 	twai_message_t msg;
 
-	if (twai_receive_v2(*bus, &msg, 0) == ESP_OK &&
+	if (twai_receive_v2(*bus, &msg, ticks_to_wait) == ESP_OK &&
 	    msg.data_length_code <= 8) {
 		int8_t i = 0;
 
@@ -147,6 +172,66 @@ bool _esp32_twai_recv(twai_handle_t *bus, struct esp32_twai_frame *frame)
 	return has_message;
 }
 
+/* RX task per bus. Blocks on TWAI RX queue and hands frames over to loop()
+ * through lock-free ring (single producer - this task, single consumer -
+ * loop), so frames are picked up as soon as they arrive */
+static struct tbcm_360_3000_he_dri_spsc twai_rx_ring[2];
+
+static TaskHandle_t      twai_rx_task[2];
+static volatile bool     twai_rx_park[2];   /* Asked to leave the driver */
+static SemaphoreHandle_t twai_rx_parked[2]; /* Task is out of the driver */
+
+void esp32_twai_rx_task(void *arg)
+{
+	uint8_t bus_id = (uint8_t)(uintptr_t)arg;
+	twai_handle_t *bus = (bus_id == 0) ? &twai_bus_0 : &twai_bus_1;
+	struct esp32_twai_frame frame;
+
+	for (;;) {
+		if (twai_rx_park[bus_id]) {
+			/* Wait here until the driver is reinstalled */
+			xSemaphoreGive(twai_rx_parked[bus_id]);
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		} else if (_esp32_twai_recv(bus, &frame, pdMS_TO_TICKS(10))) {
+			tbcm_360_3000_he_dri_spsc_push(&twai_rx_ring[bus_id],
+				(struct tbcm_360_3000_he_dri_frame *)&frame);
+		} else {}
+	}
+}
+
+/* Stop RX task of the bus, returns once it's out of twai_receive */
+void esp32_twai_rx_stop(uint8_t bus_id)
+{
+	if (!twai_rx_park[bus_id]) {
+		twai_rx_park[bus_id] = true;
+		xSemaphoreTake(twai_rx_parked[bus_id], portMAX_DELAY);
+	}
+}
+
+void esp32_twai_rx_start(uint8_t bus_id)
+{
+	twai_rx_park[bus_id] = false;
+	xTaskNotifyGive(twai_rx_task[bus_id]);
+}
+
+/* Reinstall TWAI in case of bus off. RX task must not be inside the
+ * driver while it's uninstalled, it stays parked if reinstall fails */
+void esp32_twai_reset(twai_handle_t *bus)
+{
+	uint8_t bus_id = (bus == &twai_bus_0) ? 0 : 1;
+
+	printf("TWAI_ALERT_BUS_OFF\n");
+
+	esp32_twai_rx_stop(bus_id);
+
+	twai_reconfigure_alerts_v2(*bus, 0, NULL);
+	_esp32_twai_kill(bus);
+
+	if (esp32_twai_init(bus)) {
+		esp32_twai_rx_start(bus_id);
+	}
+}
+
 void esp32_twai_update()
 {
 	uint32_t alerts;
@@ -155,24 +240,14 @@ void esp32_twai_update()
 	twai_read_alerts_v2(twai_bus_0, &alerts, 0);
 
 	if (alerts & TWAI_ALERT_BUS_OFF) {
-		printf("TWAI_ALERT_BUS_OFF\n");
-
-		/* Reset TWAI in case of bus off */
-		twai_reconfigure_alerts_v2(twai_bus_0, 0, NULL);
-		_esp32_twai_kill(&twai_bus_0);
-		_esp32_twai_kill(&twai_bus_0);
+		esp32_twai_reset(&twai_bus_0);
 	}
 
 	alerts = 0;
 	twai_read_alerts_v2(twai_bus_1, &alerts, 0);
 
 	if (alerts & TWAI_ALERT_BUS_OFF) {
-		printf("TWAI_ALERT_BUS_OFF\n");
-
-		/* Reset TWAI in case of bus off */
-		twai_reconfigure_alerts_v2(twai_bus_1, 0, NULL);
-		_esp32_twai_kill(&twai_bus_1);
-		_esp32_twai_kill(&twai_bus_1);
+		esp32_twai_reset(&twai_bus_1);
 	}
 }
 
@@ -192,9 +267,9 @@ bool esp32_twai_recv_frame(uint8_t bus_id, struct esp32_twai_frame *frame)
 	bool has_frame;
 
 	if (bus_id == 0) {
-		has_frame = _esp32_twai_recv(&twai_bus_0, frame);
+		has_frame = _esp32_twai_recv(&twai_bus_0, frame, 0);
 	} else if (bus_id == 1) {
-		has_frame = _esp32_twai_recv(&twai_bus_1, frame);
+		has_frame = _esp32_twai_recv(&twai_bus_1, frame, 0);
 	} else {
 		has_frame = false;
 	}
@@ -205,8 +280,6 @@ bool esp32_twai_recv_frame(uint8_t bus_id, struct esp32_twai_frame *frame)
 /******************************************************************************
  * MAIN
  *****************************************************************************/
-#define TBCM_360_3000_HE_DRI_LOG(v) {printf v;}
-#include "tbcm_360_3000_he_dri.h"
 #include "delta_time.h"
 
 struct delta_time dt;
@@ -216,8 +289,22 @@ void setup()
 {
 	Serial.begin(921600);
 
-	esp32_twai_init(&twai_bus_0);
-	esp32_twai_init(&twai_bus_1);
+	/* RX task of a bus without driver starts parked, it never spins */
+	twai_rx_park[0] = !esp32_twai_init(&twai_bus_0);
+	twai_rx_park[1] = !esp32_twai_init(&twai_bus_1);
+
+	tbcm_360_3000_he_dri_spsc_init(&twai_rx_ring[0]);
+	tbcm_360_3000_he_dri_spsc_init(&twai_rx_ring[1]);
+
+	twai_rx_parked[0] = xSemaphoreCreateBinary();
+	twai_rx_parked[1] = xSemaphoreCreateBinary();
+
+	/* Just above loop() (setup runs in loop task), so frames are moved
+	 * to the ring before loop() looks, without starving anything else */
+	xTaskCreate(esp32_twai_rx_task, "twai_rx0", 2048, (void *)0,
+		    uxTaskPriorityGet(NULL) + 1, &twai_rx_task[0]);
+	xTaskCreate(esp32_twai_rx_task, "twai_rx1", 2048, (void *)1,
+		    uxTaskPriorityGet(NULL) + 1, &twai_rx_task[1]);
 
 	delta_time_init(&dt);
 	tbcm_360_3000_he_dri_init(&tbcm_dri);
@@ -231,15 +318,12 @@ void loop()
 
 	esp32_twai_update();
 
-	if (esp32_twai_recv_frame(0, (struct esp32_twai_frame *)&frame)) {
-		tbcm_360_3000_he_dri_write_frame(&tbcm_dri, &frame);
-	}
-
-	if (esp32_twai_recv_frame(1, (struct esp32_twai_frame *)&frame)) {
-		tbcm_360_3000_he_dri_write_frame(&tbcm_dri, &frame);
-	}
+	/* Drain whole RX burst, driver will process it within single update.
+	 * Whatever does not fit into driver stays in the ring */
+	tbcm_360_3000_he_dri_spsc_drain(&twai_rx_ring[0], &tbcm_dri);
+	tbcm_360_3000_he_dri_spsc_drain(&twai_rx_ring[1], &tbcm_dri);
 
-	if (tbcm_360_3000_he_dri_read_frame(&tbcm_dri, &frame)) {
+	while (tbcm_360_3000_he_dri_read_frame(&tbcm_dri, &frame)) {
 		esp32_twai_send_frame(0, (struct esp32_twai_frame *)&frame);
 		esp32_twai_send_frame(1, (struct esp32_twai_frame *)&frame);
 	}
@@ -260,7 +344,7 @@ void loop()
 
 	case TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED:
 		tbcm_360_3000_he_dri_set_defaults(&tbcm_dri);
-		tbcm_360_3000_he_dri_set_voltage_V(&tbcm_dri, 350);
+		tbcm_360_3000_he_dri_set_voltage_dV(&tbcm_dri, 3500U);
 		tbcm_360_3000_he_dri_set_charging_mode(&tbcm_dri, 1);
 		break;
 
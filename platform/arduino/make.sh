@@ -65,6 +65,7 @@ compile() {
 	# Copy all necessary files into build/
 	cp arduino.ino build/build.ino
 	cp *.h build/
+	cp ../common/*.h build/
 	cp ../../*.h build/
 
 
@@ -0,0 +1,141 @@
+/** Lock-free single-producer/single-consumer ring of CAN frames.
+ *
+ * Hands frames over from CAN RX interrupt (or RX thread) to the task that
+ * owns the driver. Producer only calls push, consumer calls pop or drain.
+ * Neither side ever blocks, allocates or takes a lock, so push is safe
+ * to be called from ISR.
+ *
+ * Requires C11 atomics (or C++11 std::atomic when compiled as C++),
+ * unlike the driver itself which is plain C89.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tbcm_360_3000_he_dri.h"
+
+#ifdef __cplusplus
+#include <atomic>
+#define TBCM_360_3000_HE_DRI_SPSC_ATOMIC(t) std::atomic<t>
+using std::atomic_load_explicit;
+using std::atomic_store_explicit;
+using std::memory_order_acquire;
+using std::memory_order_release;
+using std::memory_order_relaxed;
+#else
+#include <stdatomic.h>
+#define TBCM_360_3000_HE_DRI_SPSC_ATOMIC(t) _Atomic t
+#endif
+
+/* Number of frames the ring can hold. Must be power of two, so free
+ * running indices wrap correctly */
+#ifndef TBCM_360_3000_HE_DRI_SPSC_SIZE
+#define TBCM_360_3000_HE_DRI_SPSC_SIZE 32U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_SPSC_SIZE < 2U) || \
+    ((TBCM_360_3000_HE_DRI_SPSC_SIZE & (TBCM_360_3000_HE_DRI_SPSC_SIZE - 1U)) \
+     != 0U)
+#error "TBCM_360_3000_HE_DRI_SPSC_SIZE must be power of two (at least 2)"
+#endif
+
+/******************************************************************************
+ * CLASS
+ *****************************************************************************/
+struct tbcm_360_3000_he_dri_spsc {
+	/* Written by producer only */
+	TBCM_360_3000_HE_DRI_SPSC_ATOMIC(uint32_t) tail;
+	TBCM_360_3000_HE_DRI_SPSC_ATOMIC(uint32_t) dropped; /* Ring was full */
+
+	struct tbcm_360_3000_he_dri_frame
+				      frames[TBCM_360_3000_HE_DRI_SPSC_SIZE];
+
+	/* Written by consumer only */
+	TBCM_360_3000_HE_DRI_SPSC_ATOMIC(uint32_t) head;
+};
+
+/******************************************************************************
+ * PUBLIC
+ *****************************************************************************/
+/* Must be called before producer and consumer are started */
+void tbcm_360_3000_he_dri_spsc_init(struct tbcm_360_3000_he_dri_spsc *self)
+{
+	atomic_store_explicit(&self->tail,    0U, memory_order_relaxed);
+	atomic_store_explicit(&self->dropped, 0U, memory_order_relaxed);
+	atomic_store_explicit(&self->head,    0U, memory_order_relaxed);
+}
+
+/* Producer side (ISR safe). Returns false if ring is full,
+ * frame is dropped and counted then */
+bool tbcm_360_3000_he_dri_spsc_push(struct tbcm_360_3000_he_dri_spsc *self,
+			       const struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint32_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+	bool has_space = (uint32_t)(tail - head) <
+			 TBCM_360_3000_HE_DRI_SPSC_SIZE;
+
+	if (has_space) {
+		self->frames[tail & (TBCM_360_3000_HE_DRI_SPSC_SIZE - 1U)] =
+									*frame;
+
+		/* Publish frame only after it was written */
+		atomic_store_explicit(&self->tail, tail + 1U,
+				      memory_order_release);
+	} else {
+		atomic_store_explicit(&self->dropped,
+			atomic_load_explicit(&self->dropped,
+					     memory_order_relaxed) + 1U,
+			memory_order_relaxed);
+	}
+
+	return has_space;
+}
+
+/* Consumer side. Returns false if ring is empty */
+bool tbcm_360_3000_he_dri_spsc_pop(struct tbcm_360_3000_he_dri_spsc *self,
+				   struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint32_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+	bool has_frame = head != tail;
+
+	if (has_frame) {
+		*frame = self->frames[head &
+				      (TBCM_360_3000_HE_DRI_SPSC_SIZE - 1U)];
+
+		/* Give slot back only after frame was copied out */
+		atomic_store_explicit(&self->head, head + 1U,
+				      memory_order_release);
+	}
+
+	return has_frame;
+}
+
+/* Consumer side. Move as many frames as driver's RX queue can take,
+ * the rest stays in the ring until next call. Returns number of frames */
+uint32_t tbcm_360_3000_he_dri_spsc_drain(
+				       struct tbcm_360_3000_he_dri_spsc *self,
+				       struct tbcm_360_3000_he_dri *dri)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint32_t free_slots = tbcm_360_3000_he_dri_get_rx_free(dri);
+	uint32_t n = 0U;
+
+	while ((n < free_slots) &&
+	       tbcm_360_3000_he_dri_spsc_pop(self, &frame)) {
+		(void)tbcm_360_3000_he_dri_write_frame(dri, &frame);
+		n++;
+	}
+
+	return n;
+}
+
+/* Frames dropped by producer because ring was full */
+uint32_t tbcm_360_3000_he_dri_spsc_get_dropped(
+				       struct tbcm_360_3000_he_dri_spsc *self)
+{
+	return atomic_load_explicit(&self->dropped, memory_order_relaxed);
+}
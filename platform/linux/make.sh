@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Setup verbose output and fail on errors
+export PS4="\e[34m>> \e[37m"; set -x; set -e
+
+cd "$(dirname "$0")"
+
+# Cleanup
+function cleanup_and_exit() {
+	local exit_code=$?
+
+	set +e;
+	rm -f spsc_stress spsc_stress_tsan 2>/dev/null
+
+	if [ "$exit_code" -eq 0 ]; then
+		echo -e "\e[32m\nSUCCESS!\e[0m"
+	else
+		echo -e "\e[31m\nERROR!\e[0m"
+	fi
+}
+
+# Trap exit
+trap cleanup_and_exit EXIT
+
+CFLAGS="-Wall -Wextra -std=c11 -pedantic -pthread -I../common -I../.."
+
+# SPSC ring stress test (optimized build, real timing).
+# Ring is sized for ~25ms of consumer wake up latency on a loaded host
+gcc spsc_stress.c $CFLAGS -DTBCM_360_3000_HE_DRI_SPSC_SIZE=128U -O2 \
+    -o spsc_stress
+./spsc_stress
+
+# Same under thread sanitizer (smaller run, it's slow)
+gcc spsc_stress.c $CFLAGS -O1 -g -fsanitize=thread -o spsc_stress_tsan
+./spsc_stress_tsan 200000 1
+
+# SocketCAN demo (run it on vcan, see vcan.sh)
+gcc socketcan_demo.c $CFLAGS -O2 -o socketcan_demo
+
+# Simulated devices for socketcan_demo (run it on vcan too)
+gcc sim_vcan.c $CFLAGS -O2 -o sim_vcan
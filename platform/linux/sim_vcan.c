@@ -0,0 +1,254 @@
+/* Simulates N TBCM 360/3000 HE devices on a SocketCAN interface.
+ *
+ * Counterpart of socketcan_demo for testing without hardware: run both on
+ * the same vcan interface (see vcan.sh), e.g.
+ *	./sim_vcan vcan0 64 &
+ *	./socketcan_demo vcan0 64
+ *
+ * Devices are tbcm_360_3000_he_sim.h models (serial no and device id are
+ * derived from index). Loop ticks every 1ms in real time, frames are read
+ * and written in batches.
+ *
+ * Usage: sim_vcan <ifname> [devices] [loss_pct] [latency_ms] [jitter_ms]
+ */
+#define _GNU_SOURCE
+
+#include <net/if.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "tbcm_360_3000_he_dri.h"
+#include "tools/sim/tbcm_360_3000_he_sim.h"
+
+#define MAX_DEVICES 255U
+#define BATCH       32U
+#define TICK_NS     1000000U
+
+static struct tbcm_360_3000_he_sim sim[MAX_DEVICES];
+
+static struct can_frame rx[BATCH];
+static struct iovec     rx_iov[BATCH];
+static struct mmsghdr   rx_msgs[BATCH];
+
+static struct can_frame tx[BATCH];
+static struct iovec     tx_iov[BATCH];
+static struct mmsghdr   tx_msgs[BATCH];
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000U) +
+	       ((uint64_t)ts.tv_nsec / 1000000U);
+}
+
+static int open_socket(const char *ifname)
+{
+	struct sockaddr_can addr;
+	int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+	if (sock >= 0) {
+		(void)memset(&addr, 0, sizeof(addr));
+		addr.can_family  = AF_CAN;
+		addr.can_ifindex = (int)if_nametoindex(ifname);
+
+		if ((addr.can_ifindex == 0) ||
+		    (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+			(void)close(sock);
+			sock = -1;
+		}
+	}
+
+	return sock;
+}
+
+static void prepare(void)
+{
+	uint32_t i;
+
+	for (i = 0U; i < BATCH; i++) {
+		rx_iov[i].iov_base = &rx[i];
+		rx_iov[i].iov_len  = sizeof(rx[i]);
+		rx_msgs[i].msg_hdr.msg_iov    = &rx_iov[i];
+		rx_msgs[i].msg_hdr.msg_iovlen = 1U;
+
+		tx_iov[i].iov_base = &tx[i];
+		tx_iov[i].iov_len  = sizeof(tx[i]);
+		tx_msgs[i].msg_hdr.msg_iov    = &tx_iov[i];
+		tx_msgs[i].msg_hdr.msg_iovlen = 1U;
+	}
+}
+
+/* Host frames go to every device, devices filter by themselves */
+static void receive(int sock, uint32_t count)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	int n;
+	int i;
+	uint32_t j;
+
+	do {
+		n = recvmmsg(sock, rx_msgs, BATCH, MSG_DONTWAIT, NULL);
+
+		for (i = 0; i < n; i++) {
+			if ((rx[i].can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG |
+					     CAN_ERR_FLAG)) != 0U) {
+				continue;
+			}
+
+			frame.id  = rx[i].can_id & CAN_SFF_MASK;
+			frame.len = rx[i].can_dlc;
+			(void)memcpy(frame.data, rx[i].data, 8U);
+
+			for (j = 0U; j < count; j++) {
+				tbcm_360_3000_he_sim_write_frame(&sim[j],
+								 &frame);
+			}
+		}
+	} while (n == (int)BATCH);
+}
+
+/* Returns number of frames the socket refused (TX queue full) */
+static uint32_t send_batch(int sock, uint32_t n)
+{
+	int sent = (n > 0U) ? sendmmsg(sock, tx_msgs, n, MSG_DONTWAIT) : 0;
+
+	return (sent < 0) ? n : (n - (uint32_t)sent);
+}
+
+int main(int argc, char **argv)
+{
+	struct tbcm_360_3000_he_sim_config cfg;
+	struct tbcm_360_3000_he_dri_frame frame;
+	struct timespec tick;
+	uint32_t devices    = 1U;
+	uint32_t loss_pct   = 0U;
+	uint32_t latency_ms = 0U;
+	uint32_t jitter_ms  = 0U;
+	uint64_t tx_frames  = 0U;
+	uint64_t tx_dropped = 0U;
+	uint64_t last;
+	uint64_t now;
+	uint32_t n;
+	uint32_t i;
+	int sock;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <ifname> [devices] [loss_pct] "
+			"[latency_ms] [jitter_ms]\n", argv[0]);
+		return 2;
+	}
+
+	if (argc > 2) {
+		devices = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+
+	if (argc > 3) {
+		loss_pct = (uint32_t)strtoul(argv[3], NULL, 0);
+	}
+
+	if (argc > 4) {
+		latency_ms = (uint32_t)strtoul(argv[4], NULL, 0);
+	}
+
+	if (argc > 5) {
+		jitter_ms = (uint32_t)strtoul(argv[5], NULL, 0);
+	}
+
+	/* Device id is 8 bit, so there can't be more devices on one bus */
+	if ((devices < 1U) || (devices > MAX_DEVICES)) {
+		fprintf(stderr, "devices must be in range 1..%u\n",
+			MAX_DEVICES);
+		return 2;
+	}
+
+	sock = open_socket(argv[1]);
+
+	if (sock < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	for (i = 0U; i < devices; i++) {
+		tbcm_360_3000_he_sim_default_config(&cfg, i);
+		cfg.loss_pct   = (uint8_t)loss_pct;
+		cfg.latency_ms = (uint16_t)latency_ms;
+		cfg.jitter_ms  = (uint16_t)jitter_ms;
+		tbcm_360_3000_he_sim_init(&sim[i], &cfg);
+	}
+
+	prepare();
+
+	(void)signal(SIGINT, on_signal);
+	(void)signal(SIGTERM, on_signal);
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &tick);
+	last = now_ms();
+
+	while (running) {
+		tick.tv_nsec += TICK_NS;
+
+		if (tick.tv_nsec >= 1000000000L) {
+			tick.tv_nsec -= 1000000000L;
+			tick.tv_sec++;
+		}
+
+		(void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tick,
+				      NULL);
+
+		receive(sock, devices);
+
+		now = now_ms();
+		n   = 0U;
+
+		for (i = 0U; i < devices; i++) {
+			tbcm_360_3000_he_sim_update(&sim[i],
+						    (uint32_t)(now - last));
+
+			while (tbcm_360_3000_he_sim_read_frame(&sim[i],
+							       &frame)) {
+				(void)memset(&tx[n], 0, sizeof(tx[n]));
+				tx[n].can_id  = frame.id;
+				tx[n].can_dlc = frame.len;
+				(void)memcpy(tx[n].data, frame.data, 8U);
+				n++;
+
+				if (n == BATCH) {
+					tx_dropped += send_batch(sock, n);
+					tx_frames  += n;
+					n = 0U;
+				}
+			}
+		}
+
+		tx_dropped += send_batch(sock, n);
+		tx_frames  += n;
+		last = now;
+	}
+
+	printf("devices=%u tx_frames=%llu tx_dropped=%llu\n", devices,
+	       (unsigned long long)tx_frames,
+	       (unsigned long long)tx_dropped);
+
+	(void)close(sock);
+
+	return 0;
+}
@@ -0,0 +1,175 @@
+/* Drives N chargers on a SocketCAN interface.
+ *
+ * Every instance takes the first device no other instance has claimed,
+ * sets it up with defaults and prints events and telemetry.
+ *
+ * Usage: socketcan_demo <ifname> [instances]
+ */
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tbcm_360_3000_he_dri.h"
+#include "tbcm_360_3000_he_dri_socketcan.h"
+
+static struct tbcm_360_3000_he_dri_bus       bus;
+static struct tbcm_360_3000_he_dri_socketcan can;
+
+/* Serial no claimed by instance (all zeros - none) */
+static uint8_t claimed[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES][6U];
+
+/* Instance has accepted its device id */
+static bool bound[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static bool is_claimed(const uint8_t *serial_no)
+{
+	uint8_t count = tbcm_360_3000_he_dri_bus_get_count(&bus);
+	uint8_t i;
+	bool    found = false;
+
+	for (i = 0U; i < count; i++) {
+		if (memcmp(claimed[i], serial_no, 6U) == 0) {
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/* Device id is taken by another instance already (data frames carry no
+ * serial no, so two instances querying at once may see the same device) */
+static bool is_owned(uint8_t index, uint8_t device_id)
+{
+	uint8_t count = tbcm_360_3000_he_dri_bus_get_count(&bus);
+	struct tbcm_360_3000_he_dri *dri;
+	uint8_t i;
+	bool    found = false;
+
+	for (i = 0U; i < count; i++) {
+		dri = tbcm_360_3000_he_dri_bus_get(&bus, i);
+
+		if ((i != index) && bound[i] &&
+		    (tbcm_360_3000_he_dri_get_device_id(dri) == device_id)) {
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static void handle_event(uint8_t index,
+			 struct tbcm_360_3000_he_dri_event_record *record)
+{
+	struct tbcm_360_3000_he_dri *dri =
+				 tbcm_360_3000_he_dri_bus_get(&bus, index);
+	const uint8_t *serial_no = tbcm_360_3000_he_dri_get_serial_no_raw(dri);
+	char buf[(6U * 2U) + 1U];
+
+	switch (record->event) {
+	case TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO:
+		if (is_claimed(serial_no)) {
+			tbcm_360_3000_he_dri_reject_serial_no(dri);
+		} else {
+			(void)memcpy(claimed[index], serial_no, 6U);
+			tbcm_360_3000_he_dri_accept_serial_no(dri);
+			printf("[%u] t=%u serial no %s\n", index,
+			       record->time_ms,
+			       tbcm_360_3000_he_dri_format_serial_no(dri, buf));
+		}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID:
+		if (is_owned(index, tbcm_360_3000_he_dri_get_device_id(dri))) {
+			tbcm_360_3000_he_dri_reject_device_id(dri);
+		} else {
+			bound[index] = true;
+			tbcm_360_3000_he_dri_accept_device_id(dri);
+			printf("[%u] t=%u device id %u\n", index,
+			       record->time_ms,
+			       tbcm_360_3000_he_dri_get_device_id(dri));
+		}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED:
+		tbcm_360_3000_he_dri_set_defaults(dri);
+		printf("[%u] t=%u established\n", index, record->time_ms);
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_FAULT:
+		(void)memset(claimed[index], 0, 6U);
+		bound[index] = false;
+		printf("[%u] t=%u fault\n", index, record->time_ms);
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED:
+		printf("[%u] t=%u link degraded\n", index, record->time_ms);
+		break;
+
+	default:
+		break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct tbcm_360_3000_he_dri_event_record record;
+	uint8_t count = 1U;
+	uint8_t i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <ifname> [instances]\n", argv[0]);
+		return 2;
+	}
+
+	if (argc > 2) {
+		count = (uint8_t)strtoul(argv[2], NULL, 0);
+	}
+
+	tbcm_360_3000_he_dri_bus_init(&bus, count);
+
+	if (!tbcm_360_3000_he_dri_socketcan_open(&can, &bus, argv[1])) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	(void)signal(SIGINT, on_signal);
+	(void)signal(SIGTERM, on_signal);
+
+	while (running && tbcm_360_3000_he_dri_socketcan_poll(&can, -1)) {
+		count = tbcm_360_3000_he_dri_bus_get_count(&bus);
+
+		for (i = 0U; i < count; i++) {
+			while (tbcm_360_3000_he_dri_pop_event(
+				  tbcm_360_3000_he_dri_bus_get(&bus, i),
+				  &record)) {
+				handle_event(i, &record);
+				tbcm_360_3000_he_dri_bus_wake(&bus, i);
+			}
+		}
+	}
+
+	printf("rx_frames=%llu rx_calls=%llu tx_frames=%llu tx_calls=%llu "
+	       "tx_dropped=%llu wakeups=%llu\n",
+	       (unsigned long long)can.rx_frames,
+	       (unsigned long long)can.rx_calls,
+	       (unsigned long long)can.tx_frames,
+	       (unsigned long long)can.tx_calls,
+	       (unsigned long long)can.tx_dropped,
+	       (unsigned long long)can.wakeups);
+
+	tbcm_360_3000_he_dri_socketcan_close(&can);
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+/* Stress test of SPSC ring (tbcm_360_3000_he_dri_spsc.h).
+ *
+ * Producer thread plays CAN RX interrupt, consumer thread plays the task
+ * which owns the driver. Every frame carries a sequence number, consumer
+ * checks that nothing is lost, duplicated or reordered.
+ *
+ * Phase 1 (flood): producer pushes as fast as it can and retries while the
+ *	ring is full (counted as ring_full), consumer drains as fast as it can.
+ * Phase 2 (paced): producer emits frames at 500 kbit/s bus rate (8 byte
+ *	standard frames, no stuffing, i.e. the worst case frame rate) in 1ms
+ *	bursts, consumer wakes up every 1ms like loop() does and feeds the
+ *	driver. A single push failure (drop) is an error here.
+ *
+ * Usage: spsc_stress [flood_frames] [paced_seconds]
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tbcm_360_3000_he_dri.h"
+#include "tbcm_360_3000_he_dri_spsc.h"
+
+#define BUS_BITRATE     500000U
+#define FRAME_BITS      111U /* Standard id, 8 data bytes, no stuffing */
+#define FRAMES_PER_SEC  (BUS_BITRATE / FRAME_BITS)
+
+struct stress {
+	struct tbcm_360_3000_he_dri_spsc ring;
+	struct tbcm_360_3000_he_dri      dri;
+
+	uint32_t frames; /* Frames to be sent */
+	bool     paced;
+
+	/* Results (consumer) */
+	uint32_t received;
+	uint32_t errors; /* Lost, duplicated or reordered */
+	uint32_t max_fill;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = (time_t)(t / 1000000000U);
+	ts.tv_nsec = (long)(t % 1000000000U);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+	{}
+}
+
+static void make_frame(struct tbcm_360_3000_he_dri_frame *frame,
+		       uint32_t seq)
+{
+	frame->id      = 0x353U + (seq % 3U);
+	frame->len     = 8U;
+	frame->data[0] = (uint8_t)(seq >> 24U);
+	frame->data[1] = (uint8_t)(seq >> 16U);
+	frame->data[2] = (uint8_t)(seq >> 8U);
+	frame->data[3] = (uint8_t)seq;
+	frame->data[4] = (uint8_t)~seq;
+	frame->data[5] = 0x5AU;
+	frame->data[6] = 0xA5U;
+	frame->data[7] = (uint8_t)(seq * 7U);
+}
+
+static void check_frame(struct stress *self,
+			const struct tbcm_360_3000_he_dri_frame *frame)
+{
+	struct tbcm_360_3000_he_dri_frame expected;
+	uint32_t seq;
+
+	seq = ((uint32_t)frame->data[0] << 24U) |
+	      ((uint32_t)frame->data[1] << 16U) |
+	      ((uint32_t)frame->data[2] << 8U) | (uint32_t)frame->data[3];
+
+	make_frame(&expected, self->received);
+
+	if ((seq != self->received) || (frame->id != expected.id) ||
+	    (memcmp(frame->data, expected.data, 8U) != 0)) {
+		if (self->errors == 0U) {
+			fprintf(stderr, "expected seq %u, got %u\n",
+				self->received, seq);
+		}
+
+		self->errors++;
+	}
+
+	self->received++;
+}
+
+static void *producer(void *arg)
+{
+	struct stress *self = (struct stress *)arg;
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint64_t start = now_ns();
+	uint64_t tick  = start;
+	uint32_t seq   = 0U;
+	uint32_t due;
+
+	while (seq < self->frames) {
+		if (self->paced) {
+			/* Frames that arrived on the bus by now */
+			tick += 1000000U;
+			sleep_until_ns(tick);
+
+			due = (uint32_t)(((tick - start) * FRAMES_PER_SEC) /
+					 1000000000U);
+		} else {
+			due = self->frames;
+		}
+
+		if (due > self->frames) {
+			due = self->frames;
+		}
+
+		while (seq < due) {
+			make_frame(&frame, seq);
+
+			if (tbcm_360_3000_he_dri_spsc_push(&self->ring,
+							   &frame)) {
+				seq++;
+			} else if (self->paced) {
+				/* Ring overflow at bus rate, frame is lost */
+				seq++;
+			} else {
+				/* Let consumer run (single core hosts) */
+				(void)sched_yield();
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct stress *self = (struct stress *)arg;
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint64_t tick = now_ns();
+	uint32_t fill;
+
+	while (self->received < self->frames) {
+		if (self->paced) {
+			tick += 1000000U;
+			sleep_until_ns(tick);
+		}
+
+		fill = atomic_load_explicit(&self->ring.tail,
+					    memory_order_acquire) -
+		       atomic_load_explicit(&self->ring.head,
+					    memory_order_relaxed);
+
+		if (fill > self->max_fill) {
+			self->max_fill = fill;
+		}
+
+		/* Feed driver the same way spsc_drain does */
+		while (tbcm_360_3000_he_dri_spsc_pop(&self->ring, &frame)) {
+			check_frame(self, &frame);
+
+			if (tbcm_360_3000_he_dri_get_rx_free(&self->dri) ==
+									   0U) {
+				(void)tbcm_360_3000_he_dri_update(&self->dri,
+								  0U);
+			}
+
+			(void)tbcm_360_3000_he_dri_write_frame(&self->dri,
+							       &frame);
+		}
+
+		(void)tbcm_360_3000_he_dri_update(&self->dri,
+						  self->paced ? 1U : 0U);
+
+		if (!self->paced) {
+			(void)sched_yield();
+		}
+
+		/* Lost frame would never arrive, stop waiting for it */
+		if (self->paced &&
+		    (tbcm_360_3000_he_dri_spsc_get_dropped(&self->ring) >
+									 0U)) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static bool run(const char *name, uint32_t frames, bool paced)
+{
+	static struct stress self;
+	pthread_t prod;
+	pthread_t cons;
+	uint64_t  start;
+	uint64_t  elapsed_ns;
+	uint32_t  dropped;
+	bool      ok;
+
+	tbcm_360_3000_he_dri_spsc_init(&self.ring);
+	tbcm_360_3000_he_dri_init(&self.dri);
+
+	self.frames   = frames;
+	self.paced    = paced;
+	self.received = 0U;
+	self.errors   = 0U;
+	self.max_fill = 0U;
+
+	start = now_ns();
+	pthread_create(&cons, NULL, consumer, &self);
+	pthread_create(&prod, NULL, producer, &self);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	elapsed_ns = now_ns() - start;
+
+	dropped = tbcm_360_3000_he_dri_spsc_get_dropped(&self.ring);
+	ok = (self.errors == 0U) && (self.received == frames) &&
+	     (!paced || (dropped == 0U));
+
+	printf("phase=%s frames=%u received=%u errors=%u ring_full=%u "
+	       "max_fill=%u ring=%u frames_per_sec=%.0f result=%s\n",
+	       name, frames, self.received, self.errors, dropped,
+	       self.max_fill, TBCM_360_3000_HE_DRI_SPSC_SIZE,
+	       (double)self.received * 1e9 / (double)elapsed_ns,
+	       ok ? "PASS" : "FAIL");
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t flood_frames  = 10000000U;
+	uint32_t paced_seconds = 3U;
+	bool ok = true;
+
+	if (argc > 1) {
+		flood_frames = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	if (argc > 2) {
+		paced_seconds = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+
+	ok = run("flood", flood_frames, false) && ok;
+	ok = run("paced", paced_seconds * FRAMES_PER_SEC, true) && ok;
+
+	return ok ? 0 : 1;
+}
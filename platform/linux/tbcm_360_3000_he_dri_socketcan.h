@@ -0,0 +1,453 @@
+/** Linux SocketCAN platform layer.
+ *
+ * Drives all instances of tbcm_360_3000_he_dri_bus from a single raw CAN
+ * socket. Single threaded, event driven:
+ *	- RX is read in batches with recvmmsg and routed by bus manager
+ *	- TX is collected from all instances and sent with sendmmsg, frames
+ *	  socket can't take yet are kept and sent when it's writable again
+ *	- kernel filters pass only frames the driver is interested in
+ *	- the loop sleeps in epoll_wait on the socket plus a timerfd, which
+ *	  is armed from the bus timer wheel, so a wakeup costs only the
+ *	  instances that are due, not all of them
+ *
+ * Instances are updated by bus manager, call tbcm_360_3000_he_dri_bus_wake
+ * after acking or changing an instance from outside.
+ *
+ * Requires Linux (SocketCAN, epoll, timerfd) and _GNU_SOURCE for
+ * recvmmsg/sendmmsg. Test with vcan (see vcan.sh).
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "tbcm_360_3000_he_dri.h"
+
+/* Max frames per recvmmsg/sendmmsg call */
+#ifndef TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH
+#define TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH 32U
+#endif
+
+/* Max kernel filters (driver merges its IDs into fewer ones anyway) */
+#define TBCM_360_3000_HE_DRI_SOCKETCAN_FILTERS 4U
+
+/******************************************************************************
+ * CLASS
+ *****************************************************************************/
+struct tbcm_360_3000_he_dri_socketcan {
+	struct tbcm_360_3000_he_dri_bus *bus;
+
+	/* Descriptors, -1 if not open */
+	int sock;  /* Raw CAN socket */
+	int epoll;
+	int timer; /* Armed from bus timer wheel deadline */
+
+	uint64_t last_ms; /* Monotonic time of the last driver update */
+
+	/* Batched I/O */
+	struct can_frame rx[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+	struct iovec     rx_iov[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+	struct mmsghdr   rx_msgs[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+
+	struct can_frame tx[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+	struct iovec     tx_iov[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+	struct mmsghdr   tx_msgs[TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH];
+
+	uint32_t tx_pending; /* Frames at the start of tx not sent yet */
+	bool     tx_wait;    /* Socket is watched for EPOLLOUT */
+
+	/* Statistics */
+	uint64_t rx_frames;
+	uint64_t rx_calls;   /* recvmmsg calls that returned frames */
+	uint64_t tx_frames;
+	uint64_t tx_calls;   /* sendmmsg calls */
+	uint64_t tx_dropped; /* Socket failed other than being full */
+	uint64_t wakeups;
+};
+
+/******************************************************************************
+ * PRIVATE
+ *****************************************************************************/
+uint64_t _tbcm_360_3000_he_dri_socketcan_now_ms(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000U) +
+	       ((uint64_t)ts.tv_nsec / 1000000U);
+}
+
+void _tbcm_360_3000_he_dri_socketcan_prepare(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	uint32_t i;
+
+	(void)memset(self->rx_msgs, 0, sizeof(self->rx_msgs));
+	(void)memset(self->tx_msgs, 0, sizeof(self->tx_msgs));
+
+	for (i = 0U; i < TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH; i++) {
+		self->rx_iov[i].iov_base = &self->rx[i];
+		self->rx_iov[i].iov_len  = sizeof(self->rx[i]);
+		self->rx_msgs[i].msg_hdr.msg_iov    = &self->rx_iov[i];
+		self->rx_msgs[i].msg_hdr.msg_iovlen = 1U;
+
+		self->tx_iov[i].iov_base = &self->tx[i];
+		self->tx_iov[i].iov_len  = sizeof(self->tx[i]);
+		self->tx_msgs[i].msg_hdr.msg_iov    = &self->tx_iov[i];
+		self->tx_msgs[i].msg_hdr.msg_iovlen = 1U;
+	}
+}
+
+/* Read everything socket has and route it to instances */
+void _tbcm_360_3000_he_dri_socketcan_rx(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	int n;
+	int i;
+
+	do {
+		n = recvmmsg(self->sock, self->rx_msgs,
+			     TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH,
+			     MSG_DONTWAIT, NULL);
+
+		if (n > 0) {
+			self->rx_calls++;
+			self->rx_frames += (uint64_t)n;
+		}
+
+		for (i = 0; i < n; i++) {
+			const struct can_frame *cf = &self->rx[i];
+
+			/* Kernel filter should not let other frames in, but
+			 * socket might be not a filtered CAN socket */
+			if ((cf->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG |
+					   CAN_ERR_FLAG)) == 0U) {
+				frame.id  = cf->can_id & CAN_SFF_MASK;
+				frame.len = (cf->can_dlc <= 8U) ? cf->can_dlc :
+								  8U;
+				(void)memcpy(frame.data, cf->data, 8U);
+
+				(void)tbcm_360_3000_he_dri_bus_write_frame(
+							    self->bus, &frame);
+			}
+		}
+	} while (n == (int)TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH);
+}
+
+/* Watch socket for EPOLLOUT only while there are pending frames */
+void _tbcm_360_3000_he_dri_socketcan_watch_tx(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  bool wait)
+{
+	struct epoll_event ev;
+
+	if (self->tx_wait != wait) {
+		(void)memset(&ev, 0, sizeof(ev));
+		ev.events  = wait ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+		ev.data.fd = self->sock;
+
+		if (epoll_ctl(self->epoll, EPOLL_CTL_MOD, self->sock,
+			      &ev) == 0) {
+			self->tx_wait = wait;
+		}
+	}
+}
+
+/* Collect frames from all instances and send them in batches.
+ * Frames the socket TX queue can't take are kept at the start of tx and
+ * sent first on the next call (socket is writable again), nothing new is
+ * read from the bus until they are out. The bus has already paced them
+ * and may have opened a query window for them */
+void _tbcm_360_3000_he_dri_socketcan_tx(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint32_t n;
+	int sent;
+
+	do {
+		n = self->tx_pending;
+
+		while ((n < TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH) &&
+		       tbcm_360_3000_he_dri_bus_read_frame(self->bus, &frame)) {
+			(void)memset(&self->tx[n], 0, sizeof(self->tx[n]));
+			self->tx[n].can_id  = frame.id & CAN_SFF_MASK;
+			self->tx[n].can_dlc = frame.len;
+			(void)memcpy(self->tx[n].data, frame.data, 8U);
+			n++;
+		}
+
+		if (n > 0U) {
+			sent = sendmmsg(self->sock, self->tx_msgs, n,
+					MSG_DONTWAIT);
+			self->tx_calls++;
+
+			if (sent >= 0) {
+				self->tx_frames += (uint64_t)sent;
+			} else if ((errno == EAGAIN) ||
+				   (errno == EWOULDBLOCK) ||
+				   (errno == ENOBUFS)) {
+				sent = 0; /* Queue full, keep all */
+			} else { /* Retry won't help, drop the batch */
+				self->tx_dropped += (uint64_t)n;
+				sent = (int)n;
+			}
+
+			self->tx_pending = n - (uint32_t)sent;
+
+			if ((sent > 0) && (self->tx_pending > 0U)) {
+				(void)memmove(&self->tx[0], &self->tx[sent],
+					      self->tx_pending *
+					      sizeof(self->tx[0]));
+			}
+		}
+	} while ((n == TBCM_360_3000_HE_DRI_SOCKETCAN_BATCH) &&
+		 (self->tx_pending == 0U));
+
+	_tbcm_360_3000_he_dri_socketcan_watch_tx(self, self->tx_pending > 0U);
+}
+
+/* One shot timer, DEADLINE_NONE disarms it */
+void _tbcm_360_3000_he_dri_socketcan_arm(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  uint32_t deadline_ms)
+{
+	struct itimerspec its;
+
+	(void)memset(&its, 0, sizeof(its));
+
+	if (deadline_ms != TBCM_360_3000_HE_DRI_DEADLINE_NONE) {
+		its.it_value.tv_sec  = (time_t)(deadline_ms / 1000U);
+		its.it_value.tv_nsec = (long)(deadline_ms % 1000U) * 1000000L;
+
+		/* Zero would disarm the timer, fire as soon as possible */
+		if (deadline_ms == 0U) {
+			its.it_value.tv_nsec = 1L;
+		}
+	}
+
+	(void)timerfd_settime(self->timer, 0, &its, NULL);
+}
+
+/* Advance bus by time elapsed since last update, only instances that
+ * are due or received frames are updated */
+void _tbcm_360_3000_he_dri_socketcan_update(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	uint64_t now = _tbcm_360_3000_he_dri_socketcan_now_ms();
+	uint32_t dt  = (uint32_t)(now - self->last_ms);
+
+	self->last_ms = now;
+
+	(void)tbcm_360_3000_he_dri_bus_update(self->bus, dt);
+}
+
+/* Close every descriptor that is open and mark it closed. This is the only
+ * cleanup path (failed attach/open and close). errno of the failure that
+ * led here is kept */
+void _tbcm_360_3000_he_dri_socketcan_close_fds(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	int err = errno;
+
+	if (self->timer >= 0) {
+		(void)close(self->timer);
+		self->timer = -1;
+	}
+
+	if (self->epoll >= 0) {
+		(void)close(self->epoll);
+		self->epoll = -1;
+	}
+
+	if (self->sock >= 0) {
+		(void)close(self->sock);
+		self->sock = -1;
+	}
+
+	errno = err;
+}
+
+/* Create epoll and timer for self->sock, nothing is closed on failure */
+bool _tbcm_360_3000_he_dri_socketcan_attach(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  struct tbcm_360_3000_he_dri_bus *bus)
+{
+	struct epoll_event ev;
+	bool ok = true;
+
+	self->bus   = bus;
+	self->epoll = epoll_create1(EPOLL_CLOEXEC);
+	self->timer = timerfd_create(CLOCK_MONOTONIC,
+				     TFD_NONBLOCK | TFD_CLOEXEC);
+
+	self->last_ms = _tbcm_360_3000_he_dri_socketcan_now_ms();
+
+	self->rx_frames  = 0U;
+	self->rx_calls   = 0U;
+	self->tx_frames  = 0U;
+	self->tx_calls   = 0U;
+	self->tx_dropped = 0U;
+	self->wakeups    = 0U;
+
+	self->tx_pending = 0U;
+	self->tx_wait    = false;
+
+	_tbcm_360_3000_he_dri_socketcan_prepare(self);
+
+	if ((self->epoll < 0) || (self->timer < 0)) {
+		ok = false;
+	} else {
+		(void)memset(&ev, 0, sizeof(ev));
+		ev.events  = EPOLLIN;
+		ev.data.fd = self->sock;
+		ok = epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->sock,
+			       &ev) == 0;
+
+		ev.data.fd = self->timer;
+		ok = ok && (epoll_ctl(self->epoll, EPOLL_CTL_ADD, self->timer,
+				      &ev) == 0);
+	}
+
+	return ok;
+}
+
+/******************************************************************************
+ * PUBLIC
+ *****************************************************************************/
+/* Use already opened socket (or any datagram socket which carries
+ * struct can_frame, e.g. for testing), it's closed by socketcan_close.
+ * Returns false on error (errno), socket is left to the caller then */
+bool tbcm_360_3000_he_dri_socketcan_attach(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  struct tbcm_360_3000_he_dri_bus *bus,
+				  int sock)
+{
+	bool ok;
+
+	self->sock  = sock;
+	self->epoll = -1;
+	self->timer = -1;
+
+	ok = _tbcm_360_3000_he_dri_socketcan_attach(self, bus);
+
+	if (!ok) {
+		self->sock = -1;
+		_tbcm_360_3000_he_dri_socketcan_close_fds(self);
+	}
+
+	return ok;
+}
+
+/* Open raw CAN socket on interface (e.g. "vcan0" or "can0"), install
+ * kernel filters and attach to it. Returns false on error (errno) */
+bool tbcm_360_3000_he_dri_socketcan_open(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  struct tbcm_360_3000_he_dri_bus *bus,
+				  const char *ifname)
+{
+	struct tbcm_360_3000_he_dri_hw_filter
+			  filters[TBCM_360_3000_HE_DRI_SOCKETCAN_FILTERS];
+	struct can_filter  kfilters[TBCM_360_3000_HE_DRI_SOCKETCAN_FILTERS];
+	struct sockaddr_can addr;
+	uint8_t count;
+	uint8_t i;
+	int     sock;
+	bool    ok;
+
+	sock = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		      CAN_RAW);
+	ok = sock >= 0;
+
+	self->sock  = sock;
+	self->epoll = -1;
+	self->timer = -1;
+
+	if (ok) {
+		count = tbcm_360_3000_he_dri_get_socketcan_filters(filters,
+				      TBCM_360_3000_HE_DRI_SOCKETCAN_FILTERS);
+
+		for (i = 0U; i < count; i++) {
+			kfilters[i].can_id   = filters[i].code;
+			kfilters[i].can_mask = filters[i].mask;
+		}
+
+		ok = setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER, kfilters,
+				count * sizeof(kfilters[0])) == 0;
+	}
+
+	if (ok) {
+		(void)memset(&addr, 0, sizeof(addr));
+		addr.can_family  = AF_CAN;
+		addr.can_ifindex = (int)if_nametoindex(ifname);
+
+		ok = (addr.can_ifindex > 0) &&
+		     (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+	}
+
+	ok = ok && _tbcm_360_3000_he_dri_socketcan_attach(self, bus);
+
+	if (!ok) {
+		_tbcm_360_3000_he_dri_socketcan_close_fds(self);
+	}
+
+	return ok;
+}
+
+/* Sleep until a frame arrives or some instance needs update (but no longer
+ * than max_wait_ms, -1 - no limit), then do all RX, updates and TX.
+ * Returns false on error (errno), EINTR is not an error */
+bool tbcm_360_3000_he_dri_socketcan_poll(
+				  struct tbcm_360_3000_he_dri_socketcan *self,
+				  int max_wait_ms)
+{
+	struct epoll_event events[2];
+	uint64_t expirations;
+	int  n;
+	int  i;
+	bool ok = true;
+
+	_tbcm_360_3000_he_dri_socketcan_arm(self,
+			tbcm_360_3000_he_dri_bus_next_deadline_ms(self->bus));
+
+	n = epoll_wait(self->epoll, events, 2, max_wait_ms);
+
+	if (n < 0) {
+		ok = errno == EINTR;
+		n  = 0;
+	}
+
+	self->wakeups++;
+
+	for (i = 0; i < n; i++) {
+		if (events[i].data.fd == self->timer) {
+			(void)read(self->timer, &expirations,
+				   sizeof(expirations));
+		} else if ((events[i].events & EPOLLIN) != 0U) {
+			_tbcm_360_3000_he_dri_socketcan_rx(self);
+		} else {} /* EPOLLOUT, pending TX goes out below */
+	}
+
+	_tbcm_360_3000_he_dri_socketcan_update(self);
+	_tbcm_360_3000_he_dri_socketcan_tx(self);
+
+	return ok;
+}
+
+void tbcm_360_3000_he_dri_socketcan_close(
+				  struct tbcm_360_3000_he_dri_socketcan *self)
+{
+	_tbcm_360_3000_he_dri_socketcan_close_fds(self);
+}
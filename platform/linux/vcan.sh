@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Create virtual CAN interface for local testing (needs root).
+# Usage: vcan.sh [ifname]
+
+set -e
+
+IFNAME="${1:-vcan0}"
+
+modprobe vcan
+if ! ip link show "$IFNAME" > /dev/null 2>&1; then
+	ip link add dev "$IFNAME" type vcan
+fi
+ip link set up "$IFNAME"
@@ -18,6 +18,7 @@
  *
  * The driver can only communicate with one device at a time, but multiple
  * 	instances of the driver can be run to achieve multiple devices support
+ * 	(see struct tbcm_360_3000_he_dri_bus, which routes frames between them)
  *
  * WARNING: the communication protocol is only suitable for TBCM series
  * 	and not compliant with protocol described in Doc No. 2086930
@@ -35,6 +36,107 @@
 #define TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS        100U
 #define TBCM_360_3000_HE_DRI_LINK_TIMEOUT_MS             5000U
 
+/* Periodic TX is not aligned to any phase (see set_tx_phase) */
+#define TBCM_360_3000_HE_DRI_TX_PHASE_NONE               0xFFFFU
+
+/* Link is declared degraded (LINK_DEGRADED event) when any data frame
+ * (0x353, 0x354, 0x355) was not seen for that many of its expected
+ * periods. It's lost (FAULT) only when main status frame 0x353 stays
+ * missing as long again, or on link timeout (0 - disabled) */
+#define TBCM_360_3000_HE_DRI_LINK_MISSED_PERIODS         3U
+
+/* Learned frame periods are never shorter than that (update granularity) */
+#define TBCM_360_3000_HE_DRI_MIN_FRAME_PERIOD_MS         20U
+
+/* Per data frame timers saturate at that value (16 bit). Periods that
+ * would take longer to be declared missed are supervised by link timeout */
+#define TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS           0xFFFFU
+
+/* No timer is running, driver needs attention only when a frame arrives */
+#define TBCM_360_3000_HE_DRI_DEADLINE_NONE               0xFFFFFFFFU
+
+/* Number of RX frames that can be buffered between two updates.
+ * Must be big enough to hold a whole burst (0x353, 0x354, 0x355 + extra) */
+#ifndef TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE
+#define TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE               8U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE < 1U) || \
+    (TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE > 255U)
+#error "TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE must be in range 1..255"
+#endif
+
+/* Number of events that can be held until popped by the host */
+#ifndef TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE
+#define TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE            8U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE < 1U) || \
+    (TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE > 255U)
+#error "TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE must be in range 1..255"
+#endif
+
+/* Log categories (bit mask). TBCM_360_3000_HE_DRI_LOG prints only the
+ * categories enabled in TBCM_360_3000_HE_DRI_LOG_MASK, the rest compile to
+ * nothing. Compiled categories can be switched at runtime as well
+ * (see tbcm_360_3000_he_dri_set_log_mask) */
+#define TBCM_360_3000_HE_DRI_LOG_EVENTS                  (1U << 0U)
+#define TBCM_360_3000_HE_DRI_LOG_RX                      (1U << 1U)
+#define TBCM_360_3000_HE_DRI_LOG_TX                      (1U << 2U)
+#define TBCM_360_3000_HE_DRI_LOG_TIMERS                  (1U << 3U)
+#define TBCM_360_3000_HE_DRI_LOG_FAULTS                  (1U << 4U)
+#define TBCM_360_3000_HE_DRI_LOG_ALL                     0x1FU
+
+#ifndef TBCM_360_3000_HE_DRI_LOG_MASK
+#define TBCM_360_3000_HE_DRI_LOG_MASK                    \
+					      TBCM_360_3000_HE_DRI_LOG_ALL
+#endif
+
+/* Number of records in binary trace ring (0 - trace is disabled).
+ * Every RX/TX frame and event takes one record, the oldest ones are
+ * overwritten. See tbcm_360_3000_he_dri_trace_dump and tools/trace_decode */
+#ifndef TBCM_360_3000_HE_DRI_TRACE_SIZE
+#define TBCM_360_3000_HE_DRI_TRACE_SIZE                  0U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 255U)
+#error "TBCM_360_3000_HE_DRI_TRACE_SIZE must be in range 0..255"
+#endif
+
+/* Size of a dumped trace record in bytes */
+#define TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE           16U
+
+/* RAM budget of a single instance in bytes (sizeof, enforced by the test).
+ * Fixed part covers everything except queues and the callback pointers,
+ * including worst case padding. RX frame takes 12 bytes, event takes 5 */
+#define TBCM_360_3000_HE_DRI_SIZE_FIXED                  160U
+
+/* Health counters (see tbcm_360_3000_he_dri_get_counters) can be compiled
+ * out with TBCM_360_3000_HE_DRI_NO_COUNTERS when RAM is tight. They take
+ * 44 bytes: 40 of struct tbcm_360_3000_he_dri_counters plus 4 of the
+ * last complete set time */
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+#define TBCM_360_3000_HE_DRI_SIZE_COUNTERS               44U
+#else
+#define TBCM_360_3000_HE_DRI_SIZE_COUNTERS               0U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+#define TBCM_360_3000_HE_DRI_SIZE_TRACE                                      \
+	((TBCM_360_3000_HE_DRI_TRACE_SIZE *                                  \
+	  TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE) + 8U)
+#else
+#define TBCM_360_3000_HE_DRI_SIZE_TRACE                  0U
+#endif
+
+#define TBCM_360_3000_HE_DRI_SIZE_BUDGET                                     \
+	(TBCM_360_3000_HE_DRI_SIZE_FIXED +                                   \
+	 TBCM_360_3000_HE_DRI_SIZE_COUNTERS +                                \
+	 TBCM_360_3000_HE_DRI_SIZE_TRACE +                                   \
+	 (TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE * 12U) +                        \
+	 (TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE * 5U) +                      \
+	 (2U * sizeof(void *)))
+
 /******************************************************************************
  * CLASS
  *****************************************************************************/
@@ -71,6 +173,9 @@ enum tbcm_360_3000_he_dri_state {
 	/* Communication with device is fully established */
 	TBCM_360_3000_HE_DRI_STATE_ESTABLISHED,
 
+	/* Link was lost, query the last known device again (warm reconnect) */
+	TBCM_360_3000_HE_DRI_STATE_RECONNECT,
+
 	/* Something has gone wrong */
 	TBCM_360_3000_HE_DRI_STATE_FAULT = (uint8_t)-1
 };
@@ -89,7 +194,15 @@ enum tbcm_360_3000_he_dri_event {
 	TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED,
 
 	/* Something went wrong */
-	TBCM_360_3000_HE_DRI_EVENT_FAULT
+	TBCM_360_3000_HE_DRI_EVENT_FAULT,
+
+	/* Complete 0x353/0x354/0x355 set was decoded. Delivered only to the
+	 * callback (too frequent to be returned by update or queued) */
+	TBCM_360_3000_HE_DRI_EVENT_TELEMETRY,
+
+	/* Some data frame missed its expected periods, link is still up.
+	 * Reported once until the frame is back */
+	TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED
 };
 
 /* Simplified CAN2.0 frame representation */
@@ -99,55 +212,234 @@ struct tbcm_360_3000_he_dri_frame {
 	uint8_t  data[8U];
 };
 
+/* Writer TX queue slots. Each slot holds at most one frame of its kind,
+ * lower index has higher priority and is read out first */
+enum tbcm_360_3000_he_dri_tx_slot {
+	/* Settings (setpoints) frame 0x352 */
+	TBCM_360_3000_HE_DRI_TX_SLOT_SETTINGS,
+
+	/* Serial number query frame 0x351 */
+	TBCM_360_3000_HE_DRI_TX_SLOT_QUERY,
+
+	TBCM_360_3000_HE_DRI_TX_SLOT_COUNT
+};
+
 /* Automata that is responsible for writing frames onto stream */
 struct tbcm_360_3000_he_dri_writer {
-	bool send_settings; /* Send settings or not? */
-	bool busy; /* No frames should be queued if we're busy */
+	bool send_settings;  /* Send settings or not? */
+	bool settings_dirty; /* x352 has changed since it was last sent */
+
+	/* Priority TX queue. Frame that is queued again before it was read
+	 * replaces the older one (it's outdated anyway).
+	 * Only payload is stored, id and length are implied by the slot */
+	uint8_t pending; /* Bit per slot, set if slot holds a frame */
+	uint8_t slots[TBCM_360_3000_HE_DRI_TX_SLOT_COUNT][8U];
 
-	/* Current(temporary/buffer) frame we're working on */
-	struct tbcm_360_3000_he_dri_frame frame;
+	/* Settings frame payload (0x352) */
+	uint8_t x352[8U];
 
-	/* Settings frame */
-	struct tbcm_360_3000_he_dri_frame x352;
+	/* Offset of periodic resends within query interval (kept over
+	 * rediscovery), TBCM_360_3000_HE_DRI_TX_PHASE_NONE - not aligned */
+	uint16_t phase_ms;
 
 	/* Timers */
 	uint32_t serial_no_timer_ms; /* Timer for serial_no resend interval */
 	uint32_t settings_timer_ms;  /* Timer for settings resend interval */
-	/* TODO check if busy for too long */
+};
+
+/* Decoded device data (0x353, 0x354, 0x355 set).
+ * Values are in protocol units, all of them are assumed (not documented) */
+struct tbcm_360_3000_he_dri_telemetry {
+	uint32_t seq;   /* Number of sets published so far (0 - none yet) */
+	bool     valid; /* Set is complete and link is alive */
+
+	uint16_t out_voltage_dV; /* Output voltage, 0.1V per bit */
+	uint16_t out_current_dA; /* Output current, 0.1A per bit */
+	int8_t   out_temp1_C;    /* Temperature 1, 1C per bit */
+	int8_t   out_temp2_C;    /* Temperature 2, 1C per bit */
+	uint8_t  in_voltage_V;   /* Input voltage, 1V per bit */
+
+	uint8_t  status[7U]; /* 0x355 payload (bytes 1..7), meaning unknown */
+};
+
+/* Performance and health counters. Event counters wrap around */
+struct tbcm_360_3000_he_dri_counters {
+	uint32_t rx_accepted;  /* Frames taken into RX queue */
+	uint32_t rx_overflows; /* Frames dropped, RX queue was full
+				  (loop runs too slow for the bus) */
+	uint32_t rx_foreign;   /* Data frames of another device id */
+
+	uint32_t tx_query;    /* 0x351 frames handed out by read_frame */
+	uint32_t tx_settings; /* 0x352 frames handed out by read_frame */
+
+	/* Settings were due again before the previous 0x352 was read out
+	 * (writer busy, the older one was overwritten) */
+	uint32_t settings_coalesced;
+
+	uint32_t link_timeouts; /* No complete data set within link timeout */
+	uint32_t missed_frames; /* Data frame missed its expected periods */
+	uint32_t reconnects;    /* Warm reconnects that got the device back */
+
+	/* Time between complete telemetry sets (0 - not known yet) */
+	uint16_t set_interval_max_ms;
+	uint16_t set_interval_avg_ms; /* Moving average, 1/8 weight */
+};
+
+/* Kind of trace record */
+enum tbcm_360_3000_he_dri_trace_type {
+	TBCM_360_3000_HE_DRI_TRACE_RX,    /* Frame written to the driver */
+	TBCM_360_3000_HE_DRI_TRACE_TX,    /* Frame read from the driver */
+	TBCM_360_3000_HE_DRI_TRACE_EVENT, /* Event emitted, id is the event */
+
+	/* Driver or reader state has changed, data holds both new states
+	 * (0 - enum tbcm_360_3000_he_dri_state,
+	 *  1 - enum tbcm_360_3000_he_dri_reader_state) */
+	TBCM_360_3000_HE_DRI_TRACE_STATE,
+
+	/* Only in dumps: records were overwritten before they were dumped,
+	 * data holds their number (32 bit) */
+	TBCM_360_3000_HE_DRI_TRACE_LOST
+};
+
+/* Trace record, no formatting is done when it's written.
+ * Dumped as 16 bytes, multibyte fields are little endian:
+ * time_ms (4), id (2), type (1), len (1), data (8) */
+struct tbcm_360_3000_he_dri_trace_record {
+	uint32_t time_ms;
+	uint16_t id;   /* CAN id or enum tbcm_360_3000_he_dri_event */
+	uint8_t  type; /* enum tbcm_360_3000_he_dri_trace_type */
+	uint8_t  len;  /* Frame length, 4 for fault event (line in data),
+			  2 for state */
+	uint8_t  data[8U];
+};
+
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+/* Ring of trace records, the newest one overwrites the oldest one */
+struct tbcm_360_3000_he_dri_trace {
+	struct tbcm_360_3000_he_dri_trace_record
+				 records[TBCM_360_3000_HE_DRI_TRACE_SIZE];
+
+	uint8_t  head;  /* Index of the oldest record */
+	uint8_t  count; /* Number of records held */
+
+	/* States as of the last TRACE_STATE record */
+	uint8_t  state;
+	uint8_t  reader_state;
+
+	uint32_t lost; /* Records overwritten since the last dump */
+};
+#endif
+
+/* Received frame as it is kept in RX queue. All IDs of interest are
+ * standard (11 bit), other IDs are stored as RX_ID_FOREIGN */
+struct tbcm_360_3000_he_dri_rx_frame {
+	uint16_t id;
+	uint8_t  len;
+	uint8_t  data[8U];
+};
+
+#define TBCM_360_3000_HE_DRI_RX_ID_FOREIGN 0xFFFFU
+
+/* Fixed size FIFO of received frames (filled by write_frame) */
+struct tbcm_360_3000_he_dri_rx_queue {
+	uint8_t  head;  /* Index of the oldest frame */
+	uint8_t  count; /* Number of frames queued */
+
+	struct tbcm_360_3000_he_dri_rx_frame
+				 frames[TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE];
+
+	uint32_t overflows; /* Frames dropped because queue was full */
 };
 
 /* Automata that is responsible for reading frames from input stream */
 struct tbcm_360_3000_he_dri_reader {
 	uint8_t state;
-	bool    busy; /* No frames should be received if we're busy */
 
-	/* Current(temporary/buffer) frame we're working on */
-	struct tbcm_360_3000_he_dri_frame frame;
+	/* The oldest queued frame is the one we're working on. It stays
+	 * in the queue until processed */
+	bool    busy; /* Working frame is taken and not yet processed */
 
 	/* Data frames */
 	uint8_t rflags; /* Reception flags (which frames were received?) */
-	struct tbcm_360_3000_he_dri_frame x353; /* rflags = 1U << 0U; */
-	struct tbcm_360_3000_he_dri_frame x354; /* rflags = 1U << 1U; */
-	struct tbcm_360_3000_he_dri_frame x355; /* rflags = 1U << 2U; */
+
+	/* Per data frame link supervision, bit per frame
+	 * (bit 0 - 0x353, bit 1 - 0x354, bit 2 - 0x355) */
+	uint8_t frame_seen;     /* Seen since bound */
+	uint8_t period_fixed;   /* Period set by user */
+	uint8_t missed_periods; /* Missed periods to declare link degraded */
+	uint8_t degraded;       /* Declared missed, not seen since */
+
+	/* Frames waiting to be processed */
+	struct tbcm_360_3000_he_dri_rx_queue queue;
+
+	/* Data frames are decoded into "next" as they arrive
+	 * (0x353: rflags = 1U << 0U, 0x354: 1U << 1U, 0x355: 1U << 2U).
+	 * When the set is complete, it's published as "telemetry" */
+	struct tbcm_360_3000_he_dri_telemetry next;
+	struct tbcm_360_3000_he_dri_telemetry telemetry;
 
 	/* Timers */
 	uint32_t link_timeout_ms; /* Link timeout (no data for too long) */
 	uint32_t link_timer_ms;   /* Link timer */
+
+	/* Saturated at FRAME_TIME_MAX_MS
+	 * (index 0 - 0x353, 1 - 0x354, 2 - 0x355) */
+	uint16_t frame_age_ms[3U];    /* Time since frame was seen last */
+	uint16_t frame_period_ms[3U]; /* Expected period, 0 - unknown yet */
 	/* TODO check if busy for too long */
 };
 
+/* Event with a timestamp */
+struct tbcm_360_3000_he_dri_event_record {
+	uint32_t time_ms; /* Driver uptime at the moment event occured */
+	uint8_t  event;   /* enum tbcm_360_3000_he_dri_event */
+};
+
+/* Bounded FIFO of events, so none of them is lost between polls.
+ * Records are stored as two arrays to avoid padding */
+struct tbcm_360_3000_he_dri_event_queue {
+	uint32_t time_ms[TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE];
+	uint8_t  event[TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE];
+
+	uint8_t  head;  /* Index of the oldest event */
+	uint8_t  count; /* Number of events queued */
+
+	uint32_t overflows; /* Events dropped because queue was full */
+};
+
 /* Main driver class */
 struct tbcm_360_3000_he_dri {
 	uint8_t _state;
 
+	/* Serial No (raw, 2 decimal digits per byte as in 0x350) */
+	uint8_t _serial_no[6U];
+	uint8_t _device_id;
+
+	/* Keep serial no, device id and settings after link loss */
+	bool _warm_reconnect;
+
 	struct tbcm_360_3000_he_dri_writer _writer;
 	struct tbcm_360_3000_he_dri_reader _reader;
 
-	/* Serial No (as string) */
-	char _serial_no[(6U * 2U) + 1U];
-	uint8_t _device_id;
+	struct tbcm_360_3000_he_dri_event_queue _events;
+
+	/* Optional notification callback (NULL if not used) */
+	void (*_callback)(void *ctx, struct tbcm_360_3000_he_dri *self,
+			  enum tbcm_360_3000_he_dri_event event);
+	void *_callback_ctx;
+
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	/* rx_overflows is kept by RX queue itself */
+	struct tbcm_360_3000_he_dri_counters _counters;
+	uint32_t _last_set_ms; /* Uptime of the last complete set */
+#endif
+
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	struct tbcm_360_3000_he_dri_trace _trace;
+#endif
 
 	/* DEBUG */
+	uint8_t  _log_mask; /* Log categories enabled at runtime */
 	int32_t  _fault_line;
 	uint32_t _time_up_ms;
 };
@@ -160,32 +452,223 @@ struct tbcm_360_3000_he_dri {
 #define TBCM_360_3000_HE_DRI_LOG(v)
 #endif
 
+/* Log v if category is enabled at runtime */
+#define TBCM_360_3000_HE_DRI_LOG_IF(self, category, v)                       \
+	do {                                                                 \
+		if (((self)->_log_mask & (category)) > 0U) {                 \
+			TBCM_360_3000_HE_DRI_LOG(v);                         \
+		}                                                            \
+	} while (0)
+
+/* Per category log macros, empty if category is not compiled in */
+#if ((TBCM_360_3000_HE_DRI_LOG_MASK) & TBCM_360_3000_HE_DRI_LOG_EVENTS)
+#define TBCM_360_3000_HE_DRI_LOG_EVENT(self, v)                              \
+	TBCM_360_3000_HE_DRI_LOG_IF(self, TBCM_360_3000_HE_DRI_LOG_EVENTS, v)
+#else
+#define TBCM_360_3000_HE_DRI_LOG_EVENT(self, v)
+#endif
+
+#if ((TBCM_360_3000_HE_DRI_LOG_MASK) & TBCM_360_3000_HE_DRI_LOG_RX)
+#define TBCM_360_3000_HE_DRI_LOG_RX_FRAME(self, v)                           \
+	TBCM_360_3000_HE_DRI_LOG_IF(self, TBCM_360_3000_HE_DRI_LOG_RX, v)
+#else
+#define TBCM_360_3000_HE_DRI_LOG_RX_FRAME(self, v)
+#endif
+
+#if ((TBCM_360_3000_HE_DRI_LOG_MASK) & TBCM_360_3000_HE_DRI_LOG_TX)
+#define TBCM_360_3000_HE_DRI_LOG_TX_FRAME(self, v)                           \
+	TBCM_360_3000_HE_DRI_LOG_IF(self, TBCM_360_3000_HE_DRI_LOG_TX, v)
+#else
+#define TBCM_360_3000_HE_DRI_LOG_TX_FRAME(self, v)
+#endif
+
+#if ((TBCM_360_3000_HE_DRI_LOG_MASK) & TBCM_360_3000_HE_DRI_LOG_TIMERS)
+#define TBCM_360_3000_HE_DRI_LOG_TIMER(self, v)                              \
+	TBCM_360_3000_HE_DRI_LOG_IF(self, TBCM_360_3000_HE_DRI_LOG_TIMERS, v)
+#else
+#define TBCM_360_3000_HE_DRI_LOG_TIMER(self, v)
+#endif
+
+#if ((TBCM_360_3000_HE_DRI_LOG_MASK) & TBCM_360_3000_HE_DRI_LOG_FAULTS)
+#define TBCM_360_3000_HE_DRI_LOG_FAULT(self, v)                              \
+	TBCM_360_3000_HE_DRI_LOG_IF(self, TBCM_360_3000_HE_DRI_LOG_FAULTS, v)
+#else
+#define TBCM_360_3000_HE_DRI_LOG_FAULT(self, v)
+#endif
+
+/* Put record into trace ring, O(1) */
+void _tbcm_360_3000_he_dri_trace(struct tbcm_360_3000_he_dri *self,
+				 enum tbcm_360_3000_he_dri_trace_type type,
+				 uint16_t id, uint8_t len, const uint8_t *data)
+{
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	struct tbcm_360_3000_he_dri_trace *trace = &self->_trace;
+	struct tbcm_360_3000_he_dri_trace_record *record;
+	uint8_t tail = (uint8_t)((trace->head + trace->count) %
+				 TBCM_360_3000_HE_DRI_TRACE_SIZE);
+
+	if (trace->count < TBCM_360_3000_HE_DRI_TRACE_SIZE) {
+		trace->count++;
+	} else {
+		trace->head = (uint8_t)((trace->head + 1U) %
+					TBCM_360_3000_HE_DRI_TRACE_SIZE);
+		trace->lost++;
+	}
+
+	record = &trace->records[tail];
+	record->time_ms = self->_time_up_ms;
+	record->id      = id;
+	record->type    = (uint8_t)type;
+	record->len     = len;
+	(void)memcpy(record->data, data, 8U);
+#endif
+	(void)self;
+	(void)type;
+	(void)id;
+	(void)len;
+	(void)data;
+}
+
+/* Put TRACE_STATE record if driver or reader state has changed since the
+ * last one. States are assigned directly all over the driver, so changes
+ * are picked up at events and at the end of calls that change states */
+void _tbcm_360_3000_he_dri_trace_states(struct tbcm_360_3000_he_dri *self)
+{
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	uint8_t states[8U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
+
+	if ((self->_state != self->_trace.state) ||
+	    (self->_reader.state != self->_trace.reader_state)) {
+		self->_trace.state        = self->_state;
+		self->_trace.reader_state = self->_reader.state;
+
+		states[0U] = self->_state;
+		states[1U] = self->_reader.state;
+		_tbcm_360_3000_he_dri_trace(self,
+					    TBCM_360_3000_HE_DRI_TRACE_STATE,
+					    0U, 2U, states);
+	}
+#endif
+	(void)self;
+}
+
+/* Write record in dump format */
+void _tbcm_360_3000_he_dri_trace_pack(
+		     const struct tbcm_360_3000_he_dri_trace_record *record,
+		     uint8_t *buf)
+{
+	buf[0U] = (uint8_t)record->time_ms;
+	buf[1U] = (uint8_t)(record->time_ms >> 8U);
+	buf[2U] = (uint8_t)(record->time_ms >> 16U);
+	buf[3U] = (uint8_t)(record->time_ms >> 24U);
+	buf[4U] = (uint8_t)record->id;
+	buf[5U] = (uint8_t)(record->id >> 8U);
+	buf[6U] = record->type;
+	buf[7U] = record->len;
+	(void)memcpy(&buf[8U], record->data, 8U);
+}
+
 void _tbcm_360_3000_he_dri_dbg_event(struct tbcm_360_3000_he_dri *self,
 				     enum tbcm_360_3000_he_dri_event event)
 {
+	uint8_t line[8U] = {0U, 0U, 0U, 0U, 0U, 0U, 0U, 0U};
+	uint8_t len = 0U;
+
 	const char *ev_names[] = {
 		"TBCM_360_3000_HE_DRI_EVENT_NONE",
 		"TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO",
 		"TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID",
 		"TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED",
-		"TBCM_360_3000_HE_DRI_EVENT_FAULT"};
+		"TBCM_360_3000_HE_DRI_EVENT_FAULT",
+		"TBCM_360_3000_HE_DRI_EVENT_TELEMETRY",
+		"TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED"};
 
 	(void)self;
 	(void)event;
+	(void)ev_names;
 
-	TBCM_360_3000_HE_DRI_LOG(("t=%10u: %s", self->_time_up_ms,
-				  ev_names[(uint8_t)event]));
+	if (event == TBCM_360_3000_HE_DRI_EVENT_FAULT) {
+		line[0U] = (uint8_t)((uint32_t)self->_fault_line);
+		line[1U] = (uint8_t)((uint32_t)self->_fault_line >> 8U);
+		line[2U] = (uint8_t)((uint32_t)self->_fault_line >> 16U);
+		line[3U] = (uint8_t)((uint32_t)self->_fault_line >> 24U);
+		len = 4U;
+	}
+
+	_tbcm_360_3000_he_dri_trace(self, TBCM_360_3000_HE_DRI_TRACE_EVENT,
+				    (uint16_t)event, len, line);
 
 	if (event == TBCM_360_3000_HE_DRI_EVENT_FAULT) {
-		TBCM_360_3000_HE_DRI_LOG((" at line %i", self->_fault_line));
+		TBCM_360_3000_HE_DRI_LOG_FAULT(self, ("t=%10u: %s at line %i\n",
+						self->_time_up_ms,
+						ev_names[(uint8_t)event],
+						self->_fault_line));
+	} else {
+		TBCM_360_3000_HE_DRI_LOG_EVENT(self, ("t=%10u: %s\n",
+						self->_time_up_ms,
+						ev_names[(uint8_t)event]));
+	}
+}
+
+/* Counters */
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+#define TBCM_360_3000_HE_DRI_COUNT(self, name) ((self)->_counters.name++)
+#else
+#define TBCM_360_3000_HE_DRI_COUNT(self, name)
+#endif
+
+void _tbcm_360_3000_he_dri_counters_init(struct tbcm_360_3000_he_dri *self)
+{
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	(void)memset(&self->_counters, 0U, sizeof(self->_counters));
+	self->_last_set_ms = TBCM_360_3000_HE_DRI_DEADLINE_NONE;
+#endif
+	(void)self;
+}
+
+/* Complete telemetry set has been published, track time between sets.
+ * Interval is measured only between sets from the same binding */
+void _tbcm_360_3000_he_dri_count_set(struct tbcm_360_3000_he_dri *self)
+{
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	struct tbcm_360_3000_he_dri_counters *c = &self->_counters;
+	uint32_t interval = self->_time_up_ms - self->_last_set_ms;
+
+	if (self->_last_set_ms != TBCM_360_3000_HE_DRI_DEADLINE_NONE) {
+		if (interval > TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS) {
+			interval = TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS;
+		}
+
+		if (interval > c->set_interval_max_ms) {
+			c->set_interval_max_ms = (uint16_t)interval;
+		}
+
+		if (c->set_interval_avg_ms == 0U) {
+			c->set_interval_avg_ms = (uint16_t)interval;
+		} else {
+			c->set_interval_avg_ms = (uint16_t)
+				((((uint32_t)c->set_interval_avg_ms * 7U) +
+				  interval + 4U) / 8U);
+		}
 	}
 
-	TBCM_360_3000_HE_DRI_LOG(("\n"));
+	self->_last_set_ms = self->_time_up_ms;
+#endif
+	(void)self;
+}
+
+/* Notify user about event (if callback is registered) */
+void _tbcm_360_3000_he_dri_notify(struct tbcm_360_3000_he_dri *self,
+				  enum tbcm_360_3000_he_dri_event event)
+{
+	if (self->_callback != NULL) {
+		self->_callback(self->_callback_ctx, self, event);
+	}
 }
 
 void _tbcm_360_3000_he_dri_dbg_frame(struct tbcm_360_3000_he_dri *self,
-				     struct tbcm_360_3000_he_dri_frame *frame,
-				     bool is_rx)
+			       const struct tbcm_360_3000_he_dri_frame *frame,
+			       bool is_rx)
 {
 	uint8_t i;
 
@@ -193,22 +676,35 @@ void _tbcm_360_3000_he_dri_dbg_frame(struct tbcm_360_3000_he_dri *self,
 	(void)frame;
 	(void)is_rx;
 
-	TBCM_360_3000_HE_DRI_LOG(("t=%10u: FRAME(%s), ID:%Xh, LEN:%u, DATA: ",
-				  self->_time_up_ms, is_rx ? "RX" : "TX",
-				  frame->id, frame->len));
+	_tbcm_360_3000_he_dri_trace(self, is_rx ?
+				    TBCM_360_3000_HE_DRI_TRACE_RX :
+				    TBCM_360_3000_HE_DRI_TRACE_TX,
+				    (uint16_t)frame->id, frame->len,
+				    frame->data);
+
+	/* Printed byte by byte, so the category check is done once here.
+	 * Categories that are not compiled in make the condition constant */
+	if ((self->_log_mask & (uint8_t)TBCM_360_3000_HE_DRI_LOG_MASK &
+	     (is_rx ? TBCM_360_3000_HE_DRI_LOG_RX :
+		      TBCM_360_3000_HE_DRI_LOG_TX)) > 0U) {
+		TBCM_360_3000_HE_DRI_LOG(("t=%10u: FRAME(%s), ID:%Xh, LEN:%u, "
+					  "DATA: ", self->_time_up_ms,
+					  is_rx ? "RX" : "TX", frame->id,
+					  frame->len));
+
+		for (i = 0; i < frame->len; i++) {
+			TBCM_360_3000_HE_DRI_LOG(("%02X ", frame->data[i]));
+		}
 
-	for (i = 0; i < frame->len; i++) {
-		TBCM_360_3000_HE_DRI_LOG(("%02X ", frame->data[i]));
+		TBCM_360_3000_HE_DRI_LOG(("\n"));
 	}
-
-	TBCM_360_3000_HE_DRI_LOG(("\n"));
 }
 
 /* Serial number related methods */
 
 void _tbcm_360_3000_he_dri_stringify_serial_no(
 					     struct tbcm_360_3000_he_dri *self,
-					     uint8_t *serial_no)
+					     char *buf)
 {
 	uint8_t i;
 	uint8_t byte_value;
@@ -217,64 +713,114 @@ void _tbcm_360_3000_he_dri_stringify_serial_no(
 	const char hex_chars[] = "0123456789ABCDEF";
 
 	for (i = 0U; i < 6U; i++) {
-		byte_value = serial_no[i];
+		byte_value = self->_serial_no[i];
 
-		self->_serial_no[i * 2U] =
-					 hex_chars[(byte_value >> 4U) & 0x0FU];
-
-		self->_serial_no[(i * 2U) + 1U] =
-					 hex_chars[byte_value & 0x0FU];
+		buf[i * 2U]        = hex_chars[(byte_value >> 4U) & 0x0FU];
+		buf[(i * 2U) + 1U] = hex_chars[byte_value & 0x0FU];
 	}
 
 	/* Null-terminate the string */
-	self->_serial_no[6U * 2U] = '\0';
+	buf[6U * 2U] = '\0';
 }
 
-uint8_t _tbcm_360_3000_he_dri_hex2int(const char c)
+bool _tbcm_360_3000_he_dri_validate_serial_no(const uint8_t *serial_no)
 {
-	uint8_t result = 0;
+	bool is_valid = true;
+	uint8_t i;
 
-	if ((c >= '0') && (c <= '9')) {
-		result = c - (uint8_t)'0';
-	} else if ((c >= 'A') && (c <= 'F')) {
-		result = c - (uint8_t)'A' + 10U;
-	} else if ((c >= 'a') && (c <= 'f')) {
-		result = c - (uint8_t)'a' + 10U;
-	} else {}
+	/* Serial number SHALL only contain 12 decimal digits (not HEX) */
+	for (i = 0U; i < 6U; i++) {
+		if (((serial_no[i] >> 4U) > 9U) ||
+		    ((serial_no[i] & 0x0FU) > 9U)) {
+			is_valid = false;
+		}
+	}
 
-	return result;
+	return is_valid;
 }
 
-void _tbcm_360_3000_he_dri_binarize_serial_no(
-					     struct tbcm_360_3000_he_dri *self,
-					     uint8_t *buf)
-{
-	uint8_t i;
+/* Timers */
 
-	for (i = 0U; i < 6U; i++) {
-		const char c_upper = self->_serial_no[i * 2U];
-		const char c_lower = self->_serial_no[(i * 2U) + 1U];
+/* Time left until timer reaches interval (0 if already expired) */
+uint32_t _tbcm_360_3000_he_dri_time_left(uint32_t timer_ms,
+					 uint32_t interval_ms)
+{
+	uint32_t left = 0U;
 
-		buf[i] = (_tbcm_360_3000_he_dri_hex2int(c_upper) << 4U) |
-			  _tbcm_360_3000_he_dri_hex2int(c_lower);
+	if (timer_ms < interval_ms) {
+		left = interval_ms - timer_ms;
 	}
+
+	return left;
 }
 
-bool _tbcm_360_3000_he_dri_validate_serial_no(const char *serial_no)
+/* Keep the earliest of two deadlines */
+uint32_t _tbcm_360_3000_he_dri_min_deadline(uint32_t a, uint32_t b)
 {
-	bool is_valid = true;
-	uint8_t i;
+	return (a < b) ? a : b;
+}
 
-	/* Serial number SHALL only contain 12 decimal digits (not HEX) */
-	for (i = 0U; i < (6U * 2U); i++) {
-		const char c = serial_no[i];
+/* Per data frame timer increment, saturates at FRAME_TIME_MAX_MS */
+uint16_t _tbcm_360_3000_he_dri_frame_time_add(uint16_t timer_ms,
+					      uint32_t delta_time_ms)
+{
+	uint32_t left = TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS - timer_ms;
 
-		if ((c < '0') || (c > '9')) {
-			is_valid = false;
-		}
+	return (delta_time_ms < left) ? (uint16_t)(timer_ms + delta_time_ms) :
+			      (uint16_t)TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS;
+}
+
+/* RX queue */
+
+void _tbcm_360_3000_he_dri_rx_queue_init(
+				    struct tbcm_360_3000_he_dri_rx_queue *self)
+{
+	self->head      = 0U;
+	self->count     = 0U;
+	self->overflows = 0U;
+}
+
+/* Store frame in compact form */
+void _tbcm_360_3000_he_dri_rx_queue_store(
+			       struct tbcm_360_3000_he_dri_rx_frame *dst,
+			       const struct tbcm_360_3000_he_dri_frame *frame)
+{
+	dst->id  = (frame->id <= 0x7FFU) ? (uint16_t)frame->id :
+				 (uint16_t)TBCM_360_3000_HE_DRI_RX_ID_FOREIGN;
+	dst->len = (frame->len <= 8U) ? frame->len : 8U;
+	(void)memcpy(dst->data, frame->data, 8U);
+}
+
+bool _tbcm_360_3000_he_dri_rx_queue_push(
+			       struct tbcm_360_3000_he_dri_rx_queue *self,
+			       const struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool    has_space = self->count < TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE;
+	uint8_t tail;
+
+	if (has_space) {
+		tail = (uint8_t)((self->head + self->count) %
+				 TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE);
+
+		_tbcm_360_3000_he_dri_rx_queue_store(&self->frames[tail],
+						     frame);
+		self->count++;
+	} else {
+		self->overflows++;
 	}
 
-	return is_valid;
+	return has_space;
+}
+
+/* Drop the oldest frame */
+void _tbcm_360_3000_he_dri_rx_queue_drop(
+				    struct tbcm_360_3000_he_dri_rx_queue *self)
+{
+	if (self->count > 0U) {
+		self->head = (uint8_t)((self->head + 1U) %
+				       TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE);
+		self->count--;
+	}
 }
 
 /* Writer */
@@ -282,11 +828,10 @@ bool _tbcm_360_3000_he_dri_validate_serial_no(const char *serial_no)
 void _tbcm_360_3000_he_dri_writer_init(struct tbcm_360_3000_he_dri *self)
 {
 	self->_writer.send_settings = false; /* Do not send settings */
-	self->_writer.busy          = false;
+	self->_writer.pending       = 0U;
 
-	self->_writer.x352.id  = 0x352U;
-	self->_writer.x352.len = 8U;
-	(void)memset(self->_writer.x352.data, 0U, 8U);
+	(void)memset(self->_writer.x352, 0U, 8U);
+	self->_writer.settings_dirty = false;
 
 	/* Timers (must trigger immediately after start) */
 	self->_writer.serial_no_timer_ms =
@@ -295,27 +840,127 @@ void _tbcm_360_3000_he_dri_writer_init(struct tbcm_360_3000_he_dri *self)
 				     TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS;
 }
 
-void _tbcm_360_3000_he_dri_writer_send_query(struct tbcm_360_3000_he_dri *self)
+/* Returns payload stored in TX slot and marks slot as pending */
+uint8_t *_tbcm_360_3000_he_dri_writer_queue(struct tbcm_360_3000_he_dri *self,
+				       enum tbcm_360_3000_he_dri_tx_slot slot)
 {
-	if (!self->_writer.busy) {
-		self->_writer.busy      = true;
-		self->_writer.frame.id  = 0x351U;
-		self->_writer.frame.len = 6U;
-		_tbcm_360_3000_he_dri_binarize_serial_no(self,
-						     self->_writer.frame.data);
-		self->_writer.serial_no_timer_ms = 0U;
+	self->_writer.pending |= (uint8_t)(1U << (uint8_t)slot);
+
+	return self->_writer.slots[slot];
+}
+
+/* Timer value right after a periodic frame has been sent. With TX phase
+ * resends are aligned to uptime (phase + k * interval, settings phase is
+ * scaled down to its interval), so instances with different phases do
+ * not send in the same millisecond and big update steps do not drift */
+uint32_t _tbcm_360_3000_he_dri_writer_restart(
+					     struct tbcm_360_3000_he_dri *self,
+					     uint32_t interval_ms)
+{
+	uint32_t timer = 0U;
+	uint32_t phase;
+
+	if (self->_writer.phase_ms != TBCM_360_3000_HE_DRI_TX_PHASE_NONE) {
+		phase = ((uint32_t)self->_writer.phase_ms * interval_ms) /
+			TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS;
+		timer = ((self->_time_up_ms % interval_ms) + interval_ms -
+			 phase) % interval_ms;
 	}
+
+	return timer;
+}
+
+/* Build 0x351 once, serial no does not change until next discovery */
+void _tbcm_360_3000_he_dri_writer_prepare_query(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	uint8_t *data = self->_writer.slots[TBCM_360_3000_HE_DRI_TX_SLOT_QUERY];
+
+	(void)memset(data, 0U, 8U);
+	(void)memcpy(data, self->_serial_no, 6U);
+}
+
+void _tbcm_360_3000_he_dri_writer_send_query(struct tbcm_360_3000_he_dri *self)
+{
+	(void)_tbcm_360_3000_he_dri_writer_queue(self,
+					   TBCM_360_3000_HE_DRI_TX_SLOT_QUERY);
+	self->_writer.serial_no_timer_ms =
+		_tbcm_360_3000_he_dri_writer_restart(self,
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
 }
 
 void _tbcm_360_3000_he_dri_writer_send_settings(
 					     struct tbcm_360_3000_he_dri *self)
 {
-	if (!self->_writer.busy) {
-		self->_writer.busy  = true;
-		self->_writer.frame = self->_writer.x352;
-		self->_writer.frame.data[0] = self->_device_id;
-		self->_writer.settings_timer_ms = 0U;
+	uint8_t *data;
+
+	if ((self->_writer.pending &
+	     (1U << (uint8_t)TBCM_360_3000_HE_DRI_TX_SLOT_SETTINGS)) > 0U) {
+		TBCM_360_3000_HE_DRI_COUNT(self, settings_coalesced);
+	}
+
+	data = _tbcm_360_3000_he_dri_writer_queue(self,
+					TBCM_360_3000_HE_DRI_TX_SLOT_SETTINGS);
+
+	(void)memcpy(data, self->_writer.x352, 8U);
+	data[0] = self->_device_id;
+	self->_writer.settings_timer_ms =
+		_tbcm_360_3000_he_dri_writer_restart(self,
+				     TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS);
+	self->_writer.settings_dirty = false;
+}
+
+/* Update settings byte, mark settings dirty only if value has changed */
+void _tbcm_360_3000_he_dri_writer_set_byte(struct tbcm_360_3000_he_dri *self,
+					   uint8_t index, uint8_t val)
+{
+	if (self->_writer.x352[index] != val) {
+		self->_writer.x352[index] = val;
+		self->_writer.settings_dirty   = true;
+	}
+}
+
+/* Frame id and length are implied by the slot */
+void _tbcm_360_3000_he_dri_writer_slot_frame(uint8_t slot,
+				      struct tbcm_360_3000_he_dri_frame *frame)
+{
+	if (slot == (uint8_t)TBCM_360_3000_HE_DRI_TX_SLOT_SETTINGS) {
+		frame->id  = 0x352U;
+		frame->len = 8U;
+	} else {
+		frame->id  = 0x351U;
+		frame->len = 6U;
+	}
+}
+
+/* Pop the highest priority frame from TX queue */
+bool _tbcm_360_3000_he_dri_writer_pop(struct tbcm_360_3000_he_dri *self,
+				      struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool    has_frame = false;
+	uint8_t slot;
+
+	for (slot = 0U; slot < (uint8_t)TBCM_360_3000_HE_DRI_TX_SLOT_COUNT;
+	     slot++) {
+		if ((self->_writer.pending & (1U << slot)) > 0U) {
+			self->_writer.pending &= (uint8_t)~(1U << slot);
+
+			_tbcm_360_3000_he_dri_writer_slot_frame(slot, frame);
+			(void)memcpy(frame->data, self->_writer.slots[slot],
+				     8U);
+			has_frame = true;
+
+			if (frame->id == 0x352U) {
+				TBCM_360_3000_HE_DRI_COUNT(self, tx_settings);
+			} else {
+				TBCM_360_3000_HE_DRI_COUNT(self, tx_query);
+			}
+
+			break;
+		}
 	}
+
+	return has_frame;
 }
 
 void _tbcm_360_3000_he_dri_writer_update(struct tbcm_360_3000_he_dri *self,
@@ -327,15 +972,24 @@ void _tbcm_360_3000_he_dri_writer_update(struct tbcm_360_3000_he_dri *self,
 
 	if (self->_writer.serial_no_timer_ms >=
 		            TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS) {
+		TBCM_360_3000_HE_DRI_LOG_TIMER(self, ("t=%10u: TIMER query\n",
+						      self->_time_up_ms));
 		_tbcm_360_3000_he_dri_writer_send_query(self);
 	}
 
-	/* Send charger settings (set voltage, current, etc) every 100ms */
+	/* Send charger settings (set voltage, current, etc) as soon as they
+	 * change, otherwise every 100ms to keep them alive */
 	if (self->_writer.send_settings) {
 		self->_writer.settings_timer_ms += delta_time_ms;
 
-		if (self->_writer.settings_timer_ms >=
-				   TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS) {
+		if (self->_writer.settings_dirty ||
+		    (self->_writer.settings_timer_ms >=
+				  TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS)) {
+			TBCM_360_3000_HE_DRI_LOG_TIMER(self,
+				("t=%10u: TIMER settings (%s)\n",
+				 self->_time_up_ms,
+				 self->_writer.settings_dirty ? "changed" :
+							       "keepalive"));
 			_tbcm_360_3000_he_dri_writer_send_settings(self);
 		}
 	}
@@ -343,65 +997,178 @@ void _tbcm_360_3000_he_dri_writer_update(struct tbcm_360_3000_he_dri *self,
 
 /* Reader */
 
-void _tbcm_360_3000_he_dri_reader_init(struct tbcm_360_3000_he_dri *self)
+/* Forget everything learned about data frames (except user configuration),
+ * must be done whenever reader binds to a device */
+void _tbcm_360_3000_he_dri_reader_reset_periods(
+					     struct tbcm_360_3000_he_dri *self)
 {
-	self->_reader.state = TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO;
-	self->_reader.busy  = false;
+	uint8_t i;
 
-	self->_reader.rflags = 0U;
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	self->_last_set_ms = TBCM_360_3000_HE_DRI_DEADLINE_NONE;
+#endif
 
-	/* Timers */
-	self->_reader.link_timeout_ms = TBCM_360_3000_HE_DRI_LINK_TIMEOUT_MS;
-	self->_reader.link_timer_ms   = 0U;
+	self->_reader.frame_seen = 0U;
+	self->_reader.degraded   = 0U;
+
+	for (i = 0U; i < 3U; i++) {
+		self->_reader.frame_age_ms[i] = 0U;
+
+		if ((self->_reader.period_fixed & (1U << i)) == 0U) {
+			self->_reader.frame_period_ms[i] = 0U;
+		}
+	}
 }
 
-void _tbcm_360_3000_he_dri_reader_accept_data(
-					     struct tbcm_360_3000_he_dri *self)
+/* Data frame has been seen, learn its period */
+void _tbcm_360_3000_he_dri_reader_seen(struct tbcm_360_3000_he_dri *self,
+				       uint8_t index)
 {
-	switch (self->_reader.frame.id) {
-	case 0x353U:
-		/* Validate reader ID */
-		if (self->_reader.frame.data[0] != self->_device_id) {
-			break;
+	uint8_t   bit      = (uint8_t)(1U << index);
+	uint32_t  interval = self->_reader.frame_age_ms[index];
+	uint16_t *period   = &self->_reader.frame_period_ms[index];
+
+	/* Zero interval means frames came within single update (batch),
+	 * that says nothing about the period */
+	if (((self->_reader.frame_seen & bit) > 0U) &&
+	    ((self->_reader.period_fixed & bit) == 0U) && (interval > 0U)) {
+		if (interval < TBCM_360_3000_HE_DRI_MIN_FRAME_PERIOD_MS) {
+			interval = TBCM_360_3000_HE_DRI_MIN_FRAME_PERIOD_MS;
 		}
 
-		self->_reader.x353 = self->_reader.frame;
+		/* Smooth out jitter (never exceeds FRAME_TIME_MAX_MS) */
+		if (*period == 0U) {
+			*period = (uint16_t)interval;
+		} else {
+			*period = (uint16_t)((((uint32_t)*period * 3U) +
+					      interval) / 4U);
+		}
+	}
 
-		/* 0 1 2 3 4 5 6 7, MSB first */
-		/* byte 6, 7 - output voltage * 10 (assumed) */
-		/* byte 4, 5 - output current * 10 (assumed) */
+	self->_reader.frame_seen |= bit;
+	self->_reader.degraded   &= (uint8_t)~bit;
+	self->_reader.frame_age_ms[index] = 0U;
+}
 
-		self->_reader.rflags |= 1U << 0U;
+/* Time left until frame is declared missing, or for missing 0x353 until
+ * link is declared lost (DEADLINE_NONE if unknown or nothing to declare) */
+uint32_t _tbcm_360_3000_he_dri_reader_time_left(
+					     struct tbcm_360_3000_he_dri *self,
+					     uint8_t index)
+{
+	uint32_t left = TBCM_360_3000_HE_DRI_DEADLINE_NONE;
+	uint32_t limit;
+	bool     degraded = (self->_reader.degraded & (1U << index)) > 0U;
+
+	if (((self->_reader.frame_seen & (1U << index)) > 0U) &&
+	    (self->_reader.frame_period_ms[index] > 0U) &&
+	    (self->_reader.missed_periods > 0U) &&
+	    (!degraded || (index == 0U))) {
+		limit = (uint32_t)self->_reader.frame_period_ms[index] *
+			self->_reader.missed_periods;
+
+		if (degraded) {
+			limit *= 2U;
+		}
+
+		if (limit > TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS) {
+			limit = TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS;
+		}
+
+		left = _tbcm_360_3000_he_dri_time_left(
+				self->_reader.frame_age_ms[index], limit);
+	}
+
+	return left;
+}
+
+void _tbcm_360_3000_he_dri_reader_init(struct tbcm_360_3000_he_dri *self)
+{
+	self->_reader.state = TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO;
+	self->_reader.busy  = false;
+
+	_tbcm_360_3000_he_dri_rx_queue_init(&self->_reader.queue);
+
+	self->_reader.rflags = 0U;
+	(void)memset(&self->_reader.next, 0U, sizeof(self->_reader.next));
+	self->_reader.telemetry = self->_reader.next;
+
+	/* Timers */
+	self->_reader.link_timeout_ms = TBCM_360_3000_HE_DRI_LINK_TIMEOUT_MS;
+	self->_reader.link_timer_ms   = 0U;
+
+	self->_reader.period_fixed   = 0U;
+	self->_reader.missed_periods = TBCM_360_3000_HE_DRI_LINK_MISSED_PERIODS;
+	_tbcm_360_3000_he_dri_reader_reset_periods(self);
+}
+
+/* Working frame (valid only while reader is busy) */
+const struct tbcm_360_3000_he_dri_rx_frame *_tbcm_360_3000_he_dri_reader_frame(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	return &self->_reader.queue.frames[self->_reader.queue.head];
+}
+
+void _tbcm_360_3000_he_dri_reader_accept_data(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	struct tbcm_360_3000_he_dri_telemetry *next = &self->_reader.next;
+	const struct tbcm_360_3000_he_dri_rx_frame *frame =
+				   _tbcm_360_3000_he_dri_reader_frame(self);
+	const uint8_t *data = frame->data;
+
+	switch (frame->id) {
+	case 0x353U:
+		/* Validate reader ID */
+		if (data[0] != self->_device_id) {
+			TBCM_360_3000_HE_DRI_COUNT(self, rx_foreign);
+			break;
+		}
+
+		/* 0 1 2 3 4 5 6 7, MSB first */
+		/* byte 6, 7 - output voltage * 10 (assumed) */
+		/* byte 4, 5 - output current * 10 (assumed) */
+		next->out_voltage_dV = (uint16_t)(((uint16_t)data[6] << 8U) |
+						  (uint16_t)data[7]);
+		next->out_current_dA = (uint16_t)(((uint16_t)data[4] << 8U) |
+						  (uint16_t)data[5]);
+
+		self->_reader.rflags |= 1U << 0U;
+		_tbcm_360_3000_he_dri_reader_seen(self, 0U);
 
 		break;
 
 	case 0x354U:
-		if (self->_reader.frame.data[0] != self->_device_id) {
+		if (data[0] != self->_device_id) {
+			TBCM_360_3000_HE_DRI_COUNT(self, rx_foreign);
 			break;
 		}
 
-		self->_reader.x354 = self->_reader.frame;
-
 		/* 0 1 2 3 4 5 6 7 MSB first */
 		/* byte 1 temp1 celsius * 1 (assumed) */
 		/* byte 2 temp2 celsius * 1 (assumed) */
 		/* byte 3?, 4 input voltage * 1 (assumed) */
 		/* byte 7 has to do something with input voltage too */
+		next->out_temp1_C  = (int8_t)data[1];
+		next->out_temp2_C  = (int8_t)data[2];
+		next->in_voltage_V = data[4];
 
 		self->_reader.rflags |= 1U << 1U;
+		_tbcm_360_3000_he_dri_reader_seen(self, 1U);
 
 		break;
 
 	case 0x355U:
-		if (self->_reader.frame.data[0] != self->_device_id) {
+		if (data[0] != self->_device_id) {
+			TBCM_360_3000_HE_DRI_COUNT(self, rx_foreign);
 			break;
 		}
 
-		self->_reader.x355 = self->_reader.frame;
-
 		/* Unknown, all zeros, maybe error flags? */
+		(void)memcpy(next->status, &data[1], 7U);
 
 		self->_reader.rflags |= 1U << 2U;
+		_tbcm_360_3000_he_dri_reader_seen(self, 2U);
 
 		break;
 
@@ -414,44 +1181,83 @@ void _tbcm_360_3000_he_dri_reader_accept_data(
 		self->_reader.link_timer_ms = 0U;
 		self->_reader.rflags        = 8U; /* All frames were got */
 
+		/* Publish coherent snapshot */
+		next->seq++;
+		next->valid = true;
+		self->_reader.telemetry = *next;
+		_tbcm_360_3000_he_dri_count_set(self);
+
 		/* We can send settings at this point */
 		self->_writer.send_settings = true;
+
+		_tbcm_360_3000_he_dri_notify(self,
+					  TBCM_360_3000_HE_DRI_EVENT_TELEMETRY);
+	}
+}
+
+/* Take the oldest queued frame as working one (if none is taken).
+ * Returns true if there's a frame to be processed */
+bool _tbcm_360_3000_he_dri_reader_fetch(struct tbcm_360_3000_he_dri *self)
+{
+	if (!self->_reader.busy) {
+		self->_reader.busy = self->_reader.queue.count > 0U;
+	}
+
+	return self->_reader.busy;
+}
+
+/* Working frame is done with, remove it from the queue */
+void _tbcm_360_3000_he_dri_reader_release(struct tbcm_360_3000_he_dri *self)
+{
+	if (self->_reader.busy) {
+		_tbcm_360_3000_he_dri_rx_queue_drop(&self->_reader.queue);
+		self->_reader.busy = false;
 	}
 }
 
 void _tbcm_360_3000_he_dri_reader_update(struct tbcm_360_3000_he_dri *self,
 					   uint32_t delta_time_ms)
 {
-	(void)delta_time_ms;
+	/* Stop draining the queue when user attention is required.
+	 * The frame that caused it is kept in working slot (busy) */
+	const struct tbcm_360_3000_he_dri_rx_frame *frame;
+	bool    done = false;
+	bool    missed;
+	uint8_t i;
 
 	switch (self->_reader.state) {
 	case TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO:
-		if (self->_reader.busy &&
-		    (self->_reader.frame.id == 0x350U) &&
-		    (self->_reader.frame.len == 6U)) {
-			_tbcm_360_3000_he_dri_stringify_serial_no(self,
-						   self->_reader.frame.data);
-
-			self->_reader.state =
-				TBCM_360_3000_HE_DRI_READER_STATE_DONE;
-		} else {
-			self->_reader.busy = false;
+		while (!done && _tbcm_360_3000_he_dri_reader_fetch(self)) {
+			frame = _tbcm_360_3000_he_dri_reader_frame(self);
+
+			if ((frame->id == 0x350U) && (frame->len == 6U)) {
+				(void)memcpy(self->_serial_no, frame->data,
+					     6U);
+
+				self->_reader.state =
+					TBCM_360_3000_HE_DRI_READER_STATE_DONE;
+				done = true;
+			} else {
+				_tbcm_360_3000_he_dri_reader_release(self);
+			}
 		}
 
 		break;
 
 	case TBCM_360_3000_HE_DRI_READER_STATE_DEVICE_ID:
-		if (self->_reader.busy &&
-		    ((self->_reader.frame.id == 0x353U) ||
-		     (self->_reader.frame.id == 0x354U) ||
-		     (self->_reader.frame.id == 0x355U)) &&
-		    (self->_reader.frame.len == 8U)) {
-			self->_reader.state =
-				      TBCM_360_3000_HE_DRI_READER_STATE_DONE;
-
-			self->_device_id = self->_reader.frame.data[0];
-		} else {
-			self->_reader.busy = false;
+		while (!done && _tbcm_360_3000_he_dri_reader_fetch(self)) {
+			frame = _tbcm_360_3000_he_dri_reader_frame(self);
+
+			if (((frame->id == 0x353U) || (frame->id == 0x354U) ||
+			     (frame->id == 0x355U)) && (frame->len == 8U)) {
+				self->_reader.state =
+					TBCM_360_3000_HE_DRI_READER_STATE_DONE;
+
+				self->_device_id = frame->data[0];
+				done = true;
+			} else {
+				_tbcm_360_3000_he_dri_reader_release(self);
+			}
 		}
 
 		break;
@@ -459,19 +1265,62 @@ void _tbcm_360_3000_he_dri_reader_update(struct tbcm_360_3000_he_dri *self,
 	case TBCM_360_3000_HE_DRI_READER_STATE_DATA:
 		self->_reader.link_timer_ms += delta_time_ms;
 
-		if (self->_reader.busy) {
+		for (i = 0U; i < 3U; i++) {
+			if ((self->_reader.frame_seen & (1U << i)) > 0U) {
+				self->_reader.frame_age_ms[i] =
+					_tbcm_360_3000_he_dri_frame_time_add(
+					  self->_reader.frame_age_ms[i],
+					  delta_time_ms);
+			}
+		}
+
+		/* Whole burst is consumed within single update */
+		while (_tbcm_360_3000_he_dri_reader_fetch(self)) {
 			_tbcm_360_3000_he_dri_reader_accept_data(self);
+			_tbcm_360_3000_he_dri_reader_release(self);
 		}
 
 		/* Check for timeout */
 		if (self->_reader.link_timer_ms >=
 		    self->_reader.link_timeout_ms) {
+			TBCM_360_3000_HE_DRI_COUNT(self, link_timeouts);
+			TBCM_360_3000_HE_DRI_LOG_FAULT(self,
+				("t=%10u: LINK TIMEOUT after %ums\n",
+				 self->_time_up_ms,
+				 self->_reader.link_timer_ms));
 			self->_reader.state =
 				     TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT;
 			self->_fault_line = __LINE__;
 		}
 
-		self->_reader.busy = false;
+		/* Check for missed periods (link degraded), main status
+		 * frame still missing after that means link is lost */
+		for (i = 0U; (i < 3U) && (self->_reader.state !=
+			(uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT);
+		     i++) {
+			missed = _tbcm_360_3000_he_dri_reader_time_left(self,
+								    i) == 0U;
+
+			if (missed &&
+			    ((self->_reader.degraded & (1U << i)) == 0U)) {
+				TBCM_360_3000_HE_DRI_COUNT(self, missed_frames);
+				TBCM_360_3000_HE_DRI_LOG_FAULT(self,
+					("t=%10u: LINK MISSED %Xh, period "
+					 "%ums\n", self->_time_up_ms,
+					 0x353U + i,
+					 self->_reader.frame_period_ms[i]));
+				self->_reader.degraded |= (uint8_t)(1U << i);
+			} else if (missed) {
+				TBCM_360_3000_HE_DRI_LOG_FAULT(self,
+					("t=%10u: LINK LOST %Xh, period "
+					 "%ums\n", self->_time_up_ms,
+					 0x353U + i,
+					 self->_reader.frame_period_ms[i]));
+				self->_reader.state =
+				     TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT;
+				self->_fault_line = __LINE__;
+			} else {}
+		}
 
 		break;
 
@@ -480,6 +1329,40 @@ void _tbcm_360_3000_he_dri_reader_update(struct tbcm_360_3000_he_dri *self,
 	}
 }
 
+/* Events */
+
+void _tbcm_360_3000_he_dri_event_queue_init(
+				 struct tbcm_360_3000_he_dri_event_queue *self)
+{
+	self->head      = 0U;
+	self->count     = 0U;
+	self->overflows = 0U;
+}
+
+/* Queue event (new events are dropped if queue is full) and log it */
+void _tbcm_360_3000_he_dri_emit(struct tbcm_360_3000_he_dri *self,
+				enum tbcm_360_3000_he_dri_event event)
+{
+	struct tbcm_360_3000_he_dri_event_queue *queue = &self->_events;
+	uint8_t tail;
+
+	_tbcm_360_3000_he_dri_trace_states(self);
+
+	if (queue->count < TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE) {
+		tail = (uint8_t)((queue->head + queue->count) %
+				 TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE);
+
+		queue->time_ms[tail] = self->_time_up_ms;
+		queue->event[tail]   = (uint8_t)event;
+		queue->count++;
+	} else {
+		queue->overflows++;
+	}
+
+	_tbcm_360_3000_he_dri_dbg_event(self, event);
+	_tbcm_360_3000_he_dri_notify(self, event);
+}
+
 /******************************************************************************
  * PUBLIC
  *****************************************************************************/
@@ -489,23 +1372,67 @@ void tbcm_360_3000_he_dri_init(struct tbcm_360_3000_he_dri *self)
 
 	_tbcm_360_3000_he_dri_reader_init(self);
 	_tbcm_360_3000_he_dri_writer_init(self);
+	_tbcm_360_3000_he_dri_event_queue_init(&self->_events);
+	_tbcm_360_3000_he_dri_counters_init(self);
+
+	self->_writer.phase_ms = TBCM_360_3000_HE_DRI_TX_PHASE_NONE;
+
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	(void)memset(&self->_trace, 0U, sizeof(self->_trace));
 
-	self->_serial_no[0U] = '\0';
+	/* Not a state (FAULT is 0xFF), so the initial one is traced */
+	self->_trace.state = 0xFEU;
+#endif
+
+	self->_callback     = NULL;
+	self->_callback_ctx = NULL;
+
+	(void)memset(self->_serial_no, 0U, 6U);
 	self->_device_id     = 0U;
 
+	self->_warm_reconnect = false;
+
 	/* DEBUG */
+	self->_log_mask   = (uint8_t)TBCM_360_3000_HE_DRI_LOG_MASK;
 	self->_fault_line = -1;
 	self->_time_up_ms =  0U;
+
+	_tbcm_360_3000_he_dri_trace_states(self);
+}
+
+/* Register callback, which is called with ctx for every queued event and
+ * for TBCM_360_3000_HE_DRI_EVENT_TELEMETRY, so consumers do work only when
+ * something has changed. Callback runs inside update and may call ack
+ * functions. Pass NULL to unregister */
+void tbcm_360_3000_he_dri_set_callback(struct tbcm_360_3000_he_dri *self,
+			void (*callback)(void *ctx,
+					 struct tbcm_360_3000_he_dri *dri,
+					 enum tbcm_360_3000_he_dri_event event),
+			void *ctx)
+{
+	self->_callback     = callback;
+	self->_callback_ctx = ctx;
 }
 
 /* Serial number */
 
-const char *tbcm_360_3000_he_dri_get_serial_no(
+/* Raw serial no (6 bytes, 2 decimal digits per byte) */
+const uint8_t *tbcm_360_3000_he_dri_get_serial_no_raw(
 					     struct tbcm_360_3000_he_dri *self)
 {
 	return self->_serial_no;
 }
 
+/* Format serial no as 12 character string, buf must hold 13 bytes */
+char *tbcm_360_3000_he_dri_format_serial_no(
+					     struct tbcm_360_3000_he_dri *self,
+					     char *buf)
+{
+	_tbcm_360_3000_he_dri_stringify_serial_no(self, buf);
+
+	return buf;
+}
+
 void tbcm_360_3000_he_dri_ack_serial_no(struct tbcm_360_3000_he_dri *self,
 					bool accept)
 {
@@ -519,19 +1446,22 @@ void tbcm_360_3000_he_dri_ack_serial_no(struct tbcm_360_3000_he_dri *self,
 	} else if (!accept) { /* If serial is rejected */
 		self->_reader.state =
 				   TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO;
-		self->_reader.busy  = false;
+		_tbcm_360_3000_he_dri_reader_release(self);
 	} else if (_tbcm_360_3000_he_dri_validate_serial_no(self->_serial_no))
 	{ /* If serial is valid */
 		_tbcm_360_3000_he_dri_writer_init(self);
+		_tbcm_360_3000_he_dri_writer_prepare_query(self);
 
 		self->_state = TBCM_360_3000_HE_DRI_STATE_QUERY_DEVICE;
 		self->_reader.state =
 				   TBCM_360_3000_HE_DRI_READER_STATE_DEVICE_ID;
-		self->_reader.busy  = false;
+		_tbcm_360_3000_he_dri_reader_release(self);
 	} else { /* serial is not valid */
 		self->_state = TBCM_360_3000_HE_DRI_STATE_FAULT;
 		self->_fault_line = __LINE__;
 	}
+
+	_tbcm_360_3000_he_dri_trace_states(self);
 }
 
 void tbcm_360_3000_he_dri_accept_serial_no(struct tbcm_360_3000_he_dri *self)
@@ -564,17 +1494,20 @@ void tbcm_360_3000_he_dri_ack_device_id(struct tbcm_360_3000_he_dri *self,
 	} else if (!accept) { /* If id is rejected */
 		self->_reader.state =
 				   TBCM_360_3000_HE_DRI_READER_STATE_DEVICE_ID;
-		self->_reader.busy  = false;
+		_tbcm_360_3000_he_dri_reader_release(self);
 	} else {
 		self->_state = TBCM_360_3000_HE_DRI_STATE_ACK_ID;
 
 		self->_reader.state = TBCM_360_3000_HE_DRI_READER_STATE_DATA;
 		self->_reader.rflags   = 0U;
 		self->_reader.link_timer_ms = 0U;
+		_tbcm_360_3000_he_dri_reader_reset_periods(self);
 
 		/* keep busy true, so DATA state will consume this frame too */
 		/* self->_reader.busy  = false; */
 	}
+
+	_tbcm_360_3000_he_dri_trace_states(self);
 }
 
 void tbcm_360_3000_he_dri_accept_device_id(struct tbcm_360_3000_he_dri *self)
@@ -589,48 +1522,303 @@ void tbcm_360_3000_he_dri_reject_device_id(struct tbcm_360_3000_he_dri *self)
 
 /* Driver I/O */
 
+/* Queue frame for processing. Returns false if RX queue is full
+ * (frame is dropped and counted as overflow) */
 bool tbcm_360_3000_he_dri_write_frame(struct tbcm_360_3000_he_dri *self,
 				      struct tbcm_360_3000_he_dri_frame *frame)
 {
-	bool accept_frame = !self->_reader.busy;
+	bool accept_frame = _tbcm_360_3000_he_dri_rx_queue_push(
+						   &self->_reader.queue, frame);
 
 	if (accept_frame) {
-		self->_reader.frame = *frame;
-		self->_reader.busy  = true;
-
-		_tbcm_360_3000_he_dri_dbg_frame(self, &self->_reader.frame,
-						true);
+		TBCM_360_3000_HE_DRI_COUNT(self, rx_accepted);
+		_tbcm_360_3000_he_dri_dbg_frame(self, frame, true);
 	}
 
 	return accept_frame;
 }
 
+/* Get next frame to be sent. Call until it returns false,
+ * so every frame due within this tick leaves in this tick */
 bool tbcm_360_3000_he_dri_read_frame(struct tbcm_360_3000_he_dri *self,
 				     struct tbcm_360_3000_he_dri_frame *frame)
 {
-	bool has_frame = self->_writer.busy;
+	bool has_frame = _tbcm_360_3000_he_dri_writer_pop(self, frame);
 
 	if (has_frame) {
-		*frame             = self->_writer.frame;
-		self->_writer.busy = false;
-
-		_tbcm_360_3000_he_dri_dbg_frame(self, &self->_writer.frame,
-						false);
+		_tbcm_360_3000_he_dri_dbg_frame(self, frame, false);
 	}
 
 	return has_frame;
 }
 
-/* Setters */
+/* Queue array of frames in one call. Frames that do not fit into RX queue
+ * are dropped and counted as overflows. Returns number of accepted frames */
+uint32_t tbcm_360_3000_he_dri_write_frames(struct tbcm_360_3000_he_dri *self,
+			       const struct tbcm_360_3000_he_dri_frame *frames,
+			       uint32_t n)
+{
+	struct tbcm_360_3000_he_dri_rx_queue *queue = &self->_reader.queue;
+
+	uint32_t free_slots = (uint32_t)TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE -
+			      queue->count;
+	uint32_t accepted   = (n < free_slots) ? n : free_slots;
+	uint32_t i;
+	uint8_t  tail;
+
+	tail = (uint8_t)((queue->head + queue->count) %
+			 TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE);
+
+	for (i = 0U; i < accepted; i++) {
+		_tbcm_360_3000_he_dri_rx_queue_store(&queue->frames[tail],
+						     &frames[i]);
+		_tbcm_360_3000_he_dri_dbg_frame(self, &frames[i], true);
+
+		tail = (uint8_t)((tail + 1U) %
+				 TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE);
+	}
+
+	queue->count     += (uint8_t)accepted;
+	queue->overflows += n - accepted;
+
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	self->_counters.rx_accepted += accepted;
+#endif
+
+	return accepted;
+}
+
+/* Fill array with up to max frames to be sent. Returns number of frames */
+uint32_t tbcm_360_3000_he_dri_read_frames(struct tbcm_360_3000_he_dri *self,
+				     struct tbcm_360_3000_he_dri_frame *out,
+				     uint32_t max)
+{
+	uint32_t n = 0U;
+
+	while ((n < max) && _tbcm_360_3000_he_dri_writer_pop(self, &out[n])) {
+		_tbcm_360_3000_he_dri_dbg_frame(self, &out[n], false);
+		n++;
+	}
+
+	return n;
+}
+
+/* Number of frames that can be written before RX queue is full */
+uint32_t tbcm_360_3000_he_dri_get_rx_free(struct tbcm_360_3000_he_dri *self)
+{
+	return (uint32_t)TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE -
+	       self->_reader.queue.count;
+}
+
+/* Number of RX frames dropped because RX queue was full */
+uint32_t tbcm_360_3000_he_dri_get_rx_overflows(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	return self->_reader.queue.overflows;
+}
+
+/* Copy all counters. Cheap and never blocks, so it can be polled from
+ * the task that runs update while the driver keeps working. All zeros
+ * (but rx_overflows) if built with TBCM_360_3000_HE_DRI_NO_COUNTERS */
+void tbcm_360_3000_he_dri_get_counters(struct tbcm_360_3000_he_dri *self,
+				   struct tbcm_360_3000_he_dri_counters *out)
+{
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	*out = self->_counters;
+#else
+	(void)memset(out, 0U, sizeof(*out));
+#endif
+	out->rx_overflows = self->_reader.queue.overflows;
+}
+
+/* Start counting from zero (interval statistics included) */
+void tbcm_360_3000_he_dri_reset_counters(struct tbcm_360_3000_he_dri *self)
+{
+	_tbcm_360_3000_he_dri_counters_init(self);
+	self->_reader.queue.overflows = 0U;
+}
+
+/* Enable log categories at runtime (TBCM_360_3000_HE_DRI_LOG_* bits).
+ * Categories not compiled in (TBCM_360_3000_HE_DRI_LOG_MASK) stay off */
+void tbcm_360_3000_he_dri_set_log_mask(struct tbcm_360_3000_he_dri *self,
+				       uint8_t mask)
+{
+	self->_log_mask = (uint8_t)(mask & TBCM_360_3000_HE_DRI_LOG_MASK);
+}
+
+uint8_t tbcm_360_3000_he_dri_get_log_mask(struct tbcm_360_3000_he_dri *self)
+{
+	return self->_log_mask;
+}
+
+/* Move the oldest trace records into buf (dump format, see
+ * struct tbcm_360_3000_he_dri_trace_record), as many as whole fit in size.
+ * If records were overwritten since the last dump, TRACE_LOST record goes
+ * first. Returns number of bytes written, 0 if trace is empty or disabled */
+uint16_t tbcm_360_3000_he_dri_trace_dump(struct tbcm_360_3000_he_dri *self,
+					 uint8_t *buf, uint16_t size)
+{
+	uint16_t n = 0U;
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	struct tbcm_360_3000_he_dri_trace *trace = &self->_trace;
+	struct tbcm_360_3000_he_dri_trace_record lost;
+	const struct tbcm_360_3000_he_dri_trace_record *record = &lost;
+
+	while ((record != NULL) &&
+	       ((uint16_t)(size - n) >=
+		TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE)) {
+		if (trace->lost > 0U) {
+			(void)memset(&lost, 0U, sizeof(lost));
+			lost.time_ms = self->_time_up_ms;
+			lost.type    = TBCM_360_3000_HE_DRI_TRACE_LOST;
+			lost.len     = 4U;
+			lost.data[0U] = (uint8_t)trace->lost;
+			lost.data[1U] = (uint8_t)(trace->lost >> 8U);
+			lost.data[2U] = (uint8_t)(trace->lost >> 16U);
+			lost.data[3U] = (uint8_t)(trace->lost >> 24U);
+			trace->lost = 0U;
+			record = &lost;
+		} else if (trace->count > 0U) {
+			record = &trace->records[trace->head];
+			trace->head = (uint8_t)((trace->head + 1U) %
+					       TBCM_360_3000_HE_DRI_TRACE_SIZE);
+			trace->count--;
+		} else {
+			record = NULL;
+		}
+
+		if (record != NULL) {
+			_tbcm_360_3000_he_dri_trace_pack(record, &buf[n]);
+			n += TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE;
+		}
+	}
+#endif
+	(void)self;
+	(void)buf;
+	(void)size;
+
+	return n;
+}
+
+/* Link supervision */
+
+/* No complete data set for that long is a fault */
+void tbcm_360_3000_he_dri_set_link_timeout_ms(struct tbcm_360_3000_he_dri *self,
+					      uint32_t timeout_ms)
+{
+	self->_reader.link_timeout_ms = timeout_ms;
+}
+
+/* Declare link degraded after that many missed periods of any data frame,
+ * lost if 0x353 stays missing as long again (0 - disable, rely on link
+ * timeout only) */
+void tbcm_360_3000_he_dri_set_link_missed_periods(
+					     struct tbcm_360_3000_he_dri *self,
+					     uint8_t missed_periods)
+{
+	self->_reader.missed_periods = missed_periods;
+}
+
+/* Configure expected period of data frame (0x353, 0x354 or 0x355).
+ * Zero period means it's learned from traffic (default).
+ * Returns false if frame id is not a data frame */
+bool tbcm_360_3000_he_dri_set_frame_period_ms(
+					     struct tbcm_360_3000_he_dri *self,
+					     uint32_t id, uint32_t period_ms)
+{
+	bool    is_data = (id >= 0x353U) && (id <= 0x355U);
+	uint8_t bit;
+
+	if (is_data) {
+		bit = (uint8_t)(1U << (id - 0x353U));
+
+		if (period_ms > TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS) {
+			period_ms = TBCM_360_3000_HE_DRI_FRAME_TIME_MAX_MS;
+		}
+
+		self->_reader.frame_period_ms[id - 0x353U] =
+							   (uint16_t)period_ms;
+
+		if (period_ms > 0U) {
+			self->_reader.period_fixed |= bit;
+		} else {
+			self->_reader.period_fixed &= (uint8_t)~bit;
+		}
+	}
+
+	return is_data;
+}
+
+/* Setters.
+ * Native (integer) API works in protocol units and never touches floats.
+ * Float API is a thin wrapper on top of it and may be removed by defining
+ * TBCM_360_3000_HE_DRI_NO_FLOAT (for targets without FPU) */
+
+/* Maximum current setpoint, 0.1A per bit */
+#define TBCM_360_3000_HE_DRI_MAX_CURRENT_DA 100U
 
 void tbcm_360_3000_he_dri_set_charging_mode(struct tbcm_360_3000_he_dri *self,
 					    uint8_t val)
 {
 	/* 0 - charging disabled, 1 - charging enabled
 	 * Probably does select constant voltage or constant current mode? */
-	self->_writer.x352.data[1] = val;
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 1U, val);
+}
+
+/* Power setpoint, 0.1W per bit (not supported by device yet) */
+void tbcm_360_3000_he_dri_set_power_dW(struct tbcm_360_3000_he_dri *self,
+				       uint32_t val)
+{
+	(void)self;
+	(void)val;
+}
+
+/* Voltage setpoint, 0.1V per bit */
+void tbcm_360_3000_he_dri_set_voltage_dV(struct tbcm_360_3000_he_dri *self,
+					 uint16_t val)
+{
+	/* voltage 0V - ?V scaled by 10x */
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 4U,
+					      (uint8_t)((val >> 8U) & 0xFFU));
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 5U,
+					      (uint8_t)((val >> 0U) & 0xFFU));
+}
+
+void _tbcm_360_3000_he_dri_set_current_raw(struct tbcm_360_3000_he_dri *self,
+					   uint16_t raw)
+{
+	/* We're setting power ratio here from 0 to 100%
+	 * have no idea what does it means, but actual current value field
+	 * has no effect on current output. Maybe its because constant voltage
+	 * mode is set? TODO specify behaviour */
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 2U,
+					      (uint8_t)((raw >> 8U) & 0xFFU));
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 3U,
+					      (uint8_t)((raw >> 0U) & 0xFFU));
+
+	/* Actual current field */
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 6U, 0U);
+	_tbcm_360_3000_he_dri_writer_set_byte(self, 7U, 0U);
+}
+
+/* Current setpoint, 0.1A per bit (clamped to 10A) */
+void tbcm_360_3000_he_dri_set_current_dA(struct tbcm_360_3000_he_dri *self,
+					 uint16_t val)
+{
+	uint16_t clamped = val;
+
+	if (val > TBCM_360_3000_HE_DRI_MAX_CURRENT_DA) {
+		clamped = TBCM_360_3000_HE_DRI_MAX_CURRENT_DA;
+	}
+
+	/* percents 0 - 100% scaled by 10x
+	 * Tests are inconsistent and actual mul appears to be 75 or so
+	 * (TODO specify, unreliable behaviour). 7.5 per 0.1A */
+	_tbcm_360_3000_he_dri_set_current_raw(self,
+					(uint16_t)((clamped * 15U) / 2U));
 }
 
+#ifndef TBCM_360_3000_HE_DRI_NO_FLOAT
 void tbcm_360_3000_he_dri_set_power_W(struct tbcm_360_3000_he_dri *self,
 				      float val)
 {
@@ -642,24 +1830,23 @@ void tbcm_360_3000_he_dri_set_voltage_V(struct tbcm_360_3000_he_dri *self,
 					float val)
 {
 	float clamped = val;
-	uint16_t raw;
 
 	if (val < 0.0f) {
 		clamped = 0.0f;
 	}
 
-	/* voltage 0V - ?V scaled by 10x */
-	raw = (uint16_t)(clamped * 10.0);
+	if (val > 6553.5f) {
+		clamped = 6553.5f;
+	}
 
-	self->_writer.x352.data[4] = (raw >> 8) & 0xFFU;
-	self->_writer.x352.data[5] = (raw >> 0) & 0xFFU;
+	tbcm_360_3000_he_dri_set_voltage_dV(self,
+					    (uint16_t)(clamped * 10.0f));
 }
 
 void tbcm_360_3000_he_dri_set_current_A(struct tbcm_360_3000_he_dri *self,
 					float val)
 {
 	float clamped = val;
-	uint16_t raw  = 0U;
 
 	if (val > 10.0f) {
 		clamped = 10.0f;
@@ -669,90 +1856,101 @@ void tbcm_360_3000_he_dri_set_current_A(struct tbcm_360_3000_he_dri *self,
 		clamped = 0.0f;
 	}
 
-	/* percents 0 - 100% scaled by 10x
-	 * Tests are inconsistent and actual mul appears to be 75 or so
-	 * (TODO specify, unreliable behaviour) */
-	raw = (uint16_t)(clamped * 75.0f);
-
-	/* We're setting power ratio here from 0 to 100%
-	 * have no idea what does it means, but actual current value field
-	 * has no effect on current output. Maybe its because constant voltage
-	 * mode is set? TODO specify behaviour */
-	self->_writer.x352.data[2] = (raw >> 8) & 0xFFU;
-	self->_writer.x352.data[3] = (raw >> 0) & 0xFFU;
-
-	/* Actual current field */
-	self->_writer.x352.data[6] = 0U;
-	self->_writer.x352.data[7] = 0U;
+	_tbcm_360_3000_he_dri_set_current_raw(self,
+					      (uint16_t)(clamped * 75.0f));
 }
+#endif /* TBCM_360_3000_HE_DRI_NO_FLOAT */
 
 void tbcm_360_3000_he_dri_set_defaults(struct tbcm_360_3000_he_dri *self)
 {
-	tbcm_360_3000_he_dri_set_voltage_V(self, 250.0f);
-	tbcm_360_3000_he_dri_set_current_A(self, 0.0f);
-	tbcm_360_3000_he_dri_set_power_W(self, 0.0f);
+	tbcm_360_3000_he_dri_set_voltage_dV(self, 2500U);
+	tbcm_360_3000_he_dri_set_current_dA(self, 0U);
+	tbcm_360_3000_he_dri_set_power_dW(self, 0U);
 	tbcm_360_3000_he_dri_set_charging_mode(self, 0U);
 }
 
 /* Getters */
 
-float tbcm_360_3000_he_dri_get_out_voltage_V(struct tbcm_360_3000_he_dri *self)
+/* Copy the whole coherent telemetry snapshot (decoded once on reception).
+ * out->valid is false until complete set is received (and after fault) */
+void tbcm_360_3000_he_dri_get_telemetry(struct tbcm_360_3000_he_dri *self,
+				  struct tbcm_360_3000_he_dri_telemetry *out)
+{
+	*out       = self->_reader.telemetry;
+	out->valid = (self->_reader.rflags & 8U) > 0U;
+}
+
+/* Output voltage, 0.1V per bit (0xFFFF if not available) */
+uint16_t tbcm_360_3000_he_dri_get_out_voltage_dV(
+					     struct tbcm_360_3000_he_dri *self)
 {
-	uint16_t raw = (int8_t)-1U;
+	uint16_t raw = (uint16_t)-1;
 
 	if ((self->_reader.rflags & 8U) > 0U) {
-		raw  = (uint16_t)self->_reader.x353.data[6] << 8U;
-		raw |= (uint16_t)self->_reader.x353.data[7] << 0U;
+		raw = self->_reader.telemetry.out_voltage_dV;
 	}
 
-	return raw / 10.0f;
+	return raw;
 }
 
-float tbcm_360_3000_he_dri_get_out_current_A(struct tbcm_360_3000_he_dri *self)
+/* Output current, 0.1A per bit (0xFFFF if not available) */
+uint16_t tbcm_360_3000_he_dri_get_out_current_dA(
+					     struct tbcm_360_3000_he_dri *self)
 {
-	uint16_t raw = (int8_t)-1U;
+	uint16_t raw = (uint16_t)-1;
 
 	if ((self->_reader.rflags & 8U) > 0U) {
-		raw  = (uint16_t)self->_reader.x353.data[4] << 8U;
-		raw |= (uint16_t)self->_reader.x353.data[5] << 0U;
+		raw = self->_reader.telemetry.out_current_dA;
 	}
 
-	return raw / 10.0f;
+	return raw;
+}
+
+#ifndef TBCM_360_3000_HE_DRI_NO_FLOAT
+float tbcm_360_3000_he_dri_get_out_voltage_V(struct tbcm_360_3000_he_dri *self)
+{
+	return tbcm_360_3000_he_dri_get_out_voltage_dV(self) / 10.0f;
+}
+
+float tbcm_360_3000_he_dri_get_out_current_A(struct tbcm_360_3000_he_dri *self)
+{
+	return tbcm_360_3000_he_dri_get_out_current_dA(self) / 10.0f;
 }
+#endif /* TBCM_360_3000_HE_DRI_NO_FLOAT */
 
 /* It's assumed that temp is an integer value, but it's may be incorrect */
 int8_t tbcm_360_3000_he_dri_get_out_temp1(struct tbcm_360_3000_he_dri *self)
 {
-	int8_t raw = (int8_t)-1U;
+	int8_t raw = (int8_t)-1;
 
 	if ((self->_reader.rflags & 8U) > 0U) {
-		raw = (int8_t)self->_reader.x354.data[1U];
+		raw = self->_reader.telemetry.out_temp1_C;
 	}
 
-	return (float)raw;
+	return raw;
 }
 
 int8_t tbcm_360_3000_he_dri_get_out_temp2(struct tbcm_360_3000_he_dri *self)
 {
-	int8_t raw = (int8_t)-1U;
+	int8_t raw = (int8_t)-1;
 
 	if ((self->_reader.rflags & 8U) > 0U) {
-		raw = (int8_t)self->_reader.x354.data[2U];
+		raw = self->_reader.telemetry.out_temp2_C;
 	}
 
-	return (float)raw;
+	return raw;
 }
 
 uint8_t tbcm_360_3000_he_dri_get_in_voltage_V(
 					     struct tbcm_360_3000_he_dri *self)
 {
-	uint8_t raw = (int8_t)-1U;
+	uint8_t raw = (uint8_t)-1;
 
 	if ((self->_reader.rflags & 8U) > 0U) {
-		raw = (int8_t)self->_reader.x354.data[4U];
+		raw = self->_reader.telemetry.in_voltage_V;
 	}
 
-	return (float)raw;
+	return raw;
 }
 
 /* Update */
@@ -762,17 +1960,74 @@ void tbcm_360_3000_he_dri_recover_from_fault(
 {
 	self->_state = TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES;
 	self->_reader.state  = TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO;
-	self->_reader.busy   = false;
+	_tbcm_360_3000_he_dri_reader_release(self);
+	self->_reader.rflags = 0U;
+	_tbcm_360_3000_he_dri_reader_reset_periods(self);
+
+	_tbcm_360_3000_he_dri_trace_states(self);
+}
+
+/* Try to get back to the last accepted device without discovery.
+ * Serial no query keeps going, settings are kept but not sent
+ * until the device answers */
+void _tbcm_360_3000_he_dri_reconnect(struct tbcm_360_3000_he_dri *self)
+{
+	self->_state = TBCM_360_3000_HE_DRI_STATE_RECONNECT;
+
+	self->_reader.state  = TBCM_360_3000_HE_DRI_READER_STATE_DATA;
+	_tbcm_360_3000_he_dri_reader_release(self);
 	self->_reader.rflags = 0U;
+	self->_reader.link_timer_ms = 0U;
+	_tbcm_360_3000_he_dri_reader_reset_periods(self);
+
+	self->_writer.send_settings = false;
+
+	_tbcm_360_3000_he_dri_trace_states(self);
+}
+
+/* Enable or disable warm reconnect. When enabled, link loss in established
+ * state does not restart discovery: the driver keeps querying the last
+ * accepted device and returns to ESTABLISHED (with last settings) as soon as
+ * it answers. FAULT event is still reported on link loss. If device does not
+ * answer within link timeout, the driver falls back to discovery */
+void tbcm_360_3000_he_dri_set_warm_reconnect(struct tbcm_360_3000_he_dri *self,
+					     bool enable)
+{
+	self->_warm_reconnect = enable;
+}
+
+/* Spread periodic TX of instances that share a bus. Serial no query is
+ * resent at uptime phase_ms + k * 1000ms, settings keepalive at
+ * phase_ms / 10 + k * 100ms (first frames still go out right away).
+ * Bus manager sets it for its instances. Phase is taken modulo query
+ * interval, TBCM_360_3000_HE_DRI_TX_PHASE_NONE (default) - resend
+ * interval is counted from the last frame */
+void tbcm_360_3000_he_dri_set_tx_phase(struct tbcm_360_3000_he_dri *self,
+				       uint16_t phase_ms)
+{
+	if (phase_ms != TBCM_360_3000_HE_DRI_TX_PHASE_NONE) {
+		phase_ms = (uint16_t)(phase_ms %
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+	}
+
+	self->_writer.phase_ms = phase_ms;
 }
 
+/* Main loop. Returns the last event occured during this call
+ * (SERIAL_NO and DEVICE_ID are repeated until user decision is made).
+ * Every event is also queued once, see tbcm_360_3000_he_dri_pop_event */
 enum tbcm_360_3000_he_dri_event tbcm_360_3000_he_dri_update(
 					     struct tbcm_360_3000_he_dri *self,
 					     uint32_t delta_time_ms)
 {
 	enum tbcm_360_3000_he_dri_event e = TBCM_360_3000_HE_DRI_EVENT_NONE;
+	uint8_t degraded;
 
-	(void)delta_time_ms;
+	/* Reader has been waiting for user decision before this update */
+	bool was_done = self->_reader.state ==
+			       (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_DONE;
+
+	self->_time_up_ms += delta_time_ms;
 
 	switch (self->_state) {
 	case TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES:
@@ -781,6 +2036,10 @@ enum tbcm_360_3000_he_dri_event tbcm_360_3000_he_dri_update(
 		if (self->_reader.state ==
 		    (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_DONE) {
 			e = TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO;
+
+			if (!was_done) {
+				_tbcm_360_3000_he_dri_emit(self, e);
+			}
 		}
 
 		break;
@@ -792,31 +2051,73 @@ enum tbcm_360_3000_he_dri_event tbcm_360_3000_he_dri_update(
 		if (self->_reader.state ==
 		    (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_DONE) {
 			e = TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID;
+
+			if (!was_done) {
+				_tbcm_360_3000_he_dri_emit(self, e);
+			}
 		}
 
 		break;
 
 	case TBCM_360_3000_HE_DRI_STATE_ACK_ID:
 		e = TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED;
+		_tbcm_360_3000_he_dri_emit(self, e);
 
 		self->_state = TBCM_360_3000_HE_DRI_STATE_ESTABLISHED;
 		/* FALLTHROUGH */
 
 	case TBCM_360_3000_HE_DRI_STATE_ESTABLISHED:
+		degraded = self->_reader.degraded;
+
+		_tbcm_360_3000_he_dri_writer_update(self, delta_time_ms);
+		_tbcm_360_3000_he_dri_reader_update(self, delta_time_ms);
+
+		if (self->_reader.state ==
+		    (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT) {
+			e = TBCM_360_3000_HE_DRI_EVENT_FAULT;
+			_tbcm_360_3000_he_dri_emit(self, e);
+
+			if (self->_warm_reconnect) {
+				_tbcm_360_3000_he_dri_reconnect(self);
+			} else {
+				tbcm_360_3000_he_dri_recover_from_fault(self);
+			}
+		} else if ((self->_reader.degraded & (uint8_t)~degraded) >
+									   0U) {
+			e = TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED;
+			_tbcm_360_3000_he_dri_emit(self, e);
+		} else {}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_STATE_RECONNECT:
 		_tbcm_360_3000_he_dri_writer_update(self, delta_time_ms);
 		_tbcm_360_3000_he_dri_reader_update(self, delta_time_ms);
 
 		if (self->_reader.state ==
 		    (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT) {
+			/* Device is gone for good, start over */
 			e = TBCM_360_3000_HE_DRI_EVENT_FAULT;
+			_tbcm_360_3000_he_dri_emit(self, e);
 
 			tbcm_360_3000_he_dri_recover_from_fault(self);
-		}
+		} else if (self->_reader.rflags != 0U) {
+			/* Device has answered, give it full timeout to
+			 * complete the data set */
+			self->_reader.link_timer_ms = 0U;
+			TBCM_360_3000_HE_DRI_COUNT(self, reconnects);
+
+			e = TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED;
+			_tbcm_360_3000_he_dri_emit(self, e);
+
+			self->_state = TBCM_360_3000_HE_DRI_STATE_ESTABLISHED;
+		} else {}
 
 		break;
 
 	case TBCM_360_3000_HE_DRI_STATE_FAULT:
 		e = TBCM_360_3000_HE_DRI_EVENT_FAULT;
+		_tbcm_360_3000_he_dri_emit(self, e);
 
 		tbcm_360_3000_he_dri_recover_from_fault(self);
 
@@ -826,10 +2127,1008 @@ enum tbcm_360_3000_he_dri_event tbcm_360_3000_he_dri_update(
 		break;
 	}
 
-	self->_time_up_ms += delta_time_ms;
-	if (e != TBCM_360_3000_HE_DRI_EVENT_NONE) {
-		_tbcm_360_3000_he_dri_dbg_event(self, e);
-	}
+	_tbcm_360_3000_he_dri_trace_states(self);
 
 	return e;
 }
+
+/* Pop the oldest queued event. Returns false if there are none */
+bool tbcm_360_3000_he_dri_pop_event(struct tbcm_360_3000_he_dri *self,
+			       struct tbcm_360_3000_he_dri_event_record *record)
+{
+	struct tbcm_360_3000_he_dri_event_queue *queue = &self->_events;
+	bool has_event = queue->count > 0U;
+
+	if (has_event) {
+		record->time_ms = queue->time_ms[queue->head];
+		record->event   = queue->event[queue->head];
+
+		queue->head = (uint8_t)((queue->head + 1U) %
+					TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE);
+		queue->count--;
+	}
+
+	return has_event;
+}
+
+/* Number of events dropped because event queue was full */
+uint32_t tbcm_360_3000_he_dri_get_event_overflows(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	return self->_events.overflows;
+}
+
+/* Milliseconds until the driver has to be updated again (serial query,
+ * settings resend or link timeout), assuming no frames arrive meanwhile.
+ * Returns 0 if update is due right now, TBCM_360_3000_HE_DRI_DEADLINE_NONE
+ * if nothing is scheduled (driver waits for frames or user decision).
+ * Host may sleep or block on CAN RX with this timeout. Frames queued for TX
+ * are not accounted, read them out right after update */
+uint32_t tbcm_360_3000_he_dri_next_deadline_ms(
+					     struct tbcm_360_3000_he_dri *self)
+{
+	uint32_t deadline = TBCM_360_3000_HE_DRI_DEADLINE_NONE;
+	uint8_t  i;
+
+	switch (self->_state) {
+	case TBCM_360_3000_HE_DRI_STATE_QUERY_DEVICE:
+		deadline = _tbcm_360_3000_he_dri_time_left(
+			      self->_writer.serial_no_timer_ms,
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+		break;
+
+	case TBCM_360_3000_HE_DRI_STATE_RECONNECT:
+		deadline = _tbcm_360_3000_he_dri_time_left(
+			      self->_writer.serial_no_timer_ms,
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+
+		deadline = _tbcm_360_3000_he_dri_min_deadline(deadline,
+				_tbcm_360_3000_he_dri_time_left(
+					       self->_reader.link_timer_ms,
+					       self->_reader.link_timeout_ms));
+		break;
+
+	case TBCM_360_3000_HE_DRI_STATE_ESTABLISHED:
+		deadline = _tbcm_360_3000_he_dri_time_left(
+			      self->_writer.serial_no_timer_ms,
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+
+		if (self->_writer.send_settings &&
+		    self->_writer.settings_dirty) {
+			deadline = 0U;
+		} else if (self->_writer.send_settings) {
+			deadline = _tbcm_360_3000_he_dri_min_deadline(deadline,
+				    _tbcm_360_3000_he_dri_time_left(
+				    self->_writer.settings_timer_ms,
+				    TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS));
+		} else {}
+
+		deadline = _tbcm_360_3000_he_dri_min_deadline(deadline,
+				_tbcm_360_3000_he_dri_time_left(
+					       self->_reader.link_timer_ms,
+					       self->_reader.link_timeout_ms));
+
+		for (i = 0U; i < 3U; i++) {
+			deadline = _tbcm_360_3000_he_dri_min_deadline(deadline,
+				   _tbcm_360_3000_he_dri_reader_time_left(self,
+									  i));
+		}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES:
+		break;
+
+	default: /* ACK_ID, FAULT are resolved by the very next update */
+		deadline = 0U;
+		break;
+	}
+
+	/* Unprocessed frames (unless reader waits for user decision) */
+	if ((self->_reader.state !=
+	     (uint8_t)TBCM_360_3000_HE_DRI_READER_STATE_DONE) &&
+	    (self->_reader.busy || (self->_reader.queue.count > 0U))) {
+		deadline = 0U;
+	}
+
+	return deadline;
+}
+
+/******************************************************************************
+ * ACCEPTANCE FILTERS
+ *****************************************************************************/
+/* The driver consumes only few standard IDs, so there's no reason to wake
+ * the CPU for every frame on a busy bus. These helpers generate minimal set
+ * of code/mask pairs to be installed into CAN controller or kernel. */
+
+/* SocketCAN (linux/can.h) flag bits, duplicated to stay hardware agnostic */
+#define TBCM_360_3000_HE_DRI_CAN_EFF_FLAG 0x80000000U
+#define TBCM_360_3000_HE_DRI_CAN_RTR_FLAG 0x40000000U
+#define TBCM_360_3000_HE_DRI_CAN_SFF_MASK 0x000007FFU
+
+/* Number of distinct IDs consumed by the driver */
+#define TBCM_360_3000_HE_DRI_RX_ID_COUNT 4U
+
+/* Frame is accepted if (id & mask) == (code & mask).
+ * Layout and meaning are the same as SocketCAN struct can_filter
+ * (can_id, can_mask), so array may be passed to CAN_RAW_FILTER as is */
+struct tbcm_360_3000_he_dri_hw_filter {
+	uint32_t code;
+	uint32_t mask;
+};
+
+/* Private */
+
+/* IDs consumed by the driver (TX only IDs 0x351, 0x352 are not needed) */
+uint32_t _tbcm_360_3000_he_dri_rx_id(uint8_t index)
+{
+	const uint32_t ids[TBCM_360_3000_HE_DRI_RX_ID_COUNT] = {
+		0x350U, 0x353U, 0x354U, 0x355U
+	};
+
+	return ids[index];
+}
+
+/* Number of standard IDs that pass the filter */
+uint32_t _tbcm_360_3000_he_dri_hw_filter_size(
+			       const struct tbcm_360_3000_he_dri_hw_filter *f)
+{
+	uint32_t size = 1U;
+	uint8_t  bit;
+
+	for (bit = 0U; bit < 11U; bit++) {
+		if ((f->mask & (1UL << bit)) == 0U) {
+			size *= 2U;
+		}
+	}
+
+	return size;
+}
+
+/* Number of driver IDs that pass the filter */
+uint32_t _tbcm_360_3000_he_dri_hw_filter_hits(
+			       const struct tbcm_360_3000_he_dri_hw_filter *f)
+{
+	uint32_t hits = 0U;
+	uint8_t  i;
+
+	for (i = 0U; i < TBCM_360_3000_HE_DRI_RX_ID_COUNT; i++) {
+		if ((_tbcm_360_3000_he_dri_rx_id(i) & f->mask) ==
+		    (f->code & f->mask)) {
+			hits++;
+		}
+	}
+
+	return hits;
+}
+
+/* Public */
+
+/* Generate up to max code/mask pairs (standard 11 bit IDs) covering all IDs
+ * consumed by the driver. Starts with exact filters and greedily merges the
+ * pair that lets through the fewest foreign IDs: lossless merges are always
+ * done, lossy ones only until result fits into max.
+ * Returns number of filters written (0 if max is 0) */
+uint8_t tbcm_360_3000_he_dri_get_hw_filters(
+				 struct tbcm_360_3000_he_dri_hw_filter *out,
+				 uint8_t max)
+{
+	struct tbcm_360_3000_he_dri_hw_filter
+				     f[TBCM_360_3000_HE_DRI_RX_ID_COUNT];
+	struct tbcm_360_3000_he_dri_hw_filter merged;
+	struct tbcm_360_3000_he_dri_hw_filter best;
+
+	uint8_t  count = TBCM_360_3000_HE_DRI_RX_ID_COUNT;
+	uint8_t  best_i;
+	uint8_t  best_j;
+	uint32_t best_extra;
+	uint32_t extra;
+	uint8_t  i;
+	uint8_t  j;
+	bool     merging = (max > 0U);
+
+	for (i = 0U; i < count; i++) {
+		f[i].code = _tbcm_360_3000_he_dri_rx_id(i);
+		f[i].mask = TBCM_360_3000_HE_DRI_CAN_SFF_MASK;
+	}
+
+	while (merging && (count > 1U)) {
+		best       = f[0];
+		best_i     = 0U;
+		best_j     = 0U;
+		best_extra = (uint32_t)-1;
+
+		for (i = 0U; i < count; i++) {
+			for (j = i + 1U; j < count; j++) {
+				merged.mask = f[i].mask & f[j].mask &
+					      ~(f[i].code ^ f[j].code);
+				merged.code = f[i].code & merged.mask;
+
+				extra = _tbcm_360_3000_he_dri_hw_filter_size(
+								      &merged) -
+					_tbcm_360_3000_he_dri_hw_filter_hits(
+								      &merged);
+
+				if (extra < best_extra) {
+					best_extra = extra;
+					best       = merged;
+					best_i     = i;
+					best_j     = j;
+				}
+			}
+		}
+
+		if ((best_extra == 0U) || (count > max)) {
+			/* Replace pair by merged filter */
+			f[best_i] = best;
+			f[best_j] = f[count - 1U];
+			count--;
+		} else {
+			merging = false;
+		}
+	}
+
+	if (max == 0U) {
+		count = 0U;
+	}
+
+	for (i = 0U; i < count; i++) {
+		out[i] = f[i];
+	}
+
+	return count;
+}
+
+/* Same as tbcm_360_3000_he_dri_get_hw_filters, but ready to be used as
+ * SocketCAN struct can_filter array (rejects extended and RTR frames) */
+uint8_t tbcm_360_3000_he_dri_get_socketcan_filters(
+				 struct tbcm_360_3000_he_dri_hw_filter *out,
+				 uint8_t max)
+{
+	uint8_t count = tbcm_360_3000_he_dri_get_hw_filters(out, max);
+	uint8_t i;
+
+	for (i = 0U; i < count; i++) {
+		out[i].mask |= TBCM_360_3000_HE_DRI_CAN_EFF_FLAG |
+			       TBCM_360_3000_HE_DRI_CAN_RTR_FLAG;
+	}
+
+	return count;
+}
+
+/******************************************************************************
+ * BUS MANAGER
+ *****************************************************************************/
+/* Bus manager owns all driver instances that share the same CAN bus.
+ * Instead of offering every RX frame to every instance, it keeps
+ * device_id -> instance table, so data frames are routed to their owner
+ * directly. Only discovery traffic is offered to unbound instances.
+ *
+ * Data frames do not carry serial no, so a device that starts talking
+ * can't be told apart from the one another instance has queried. The bus
+ * lets only one instance at a time have its device query (0x351) on the
+ * bus and offers device ids nobody owns to that instance only. Query
+ * window is closed when the instance leaves QUERY_DEVICE, or after one
+ * query interval without an accepted answer, so others get their turn.
+ * There is one query per window, a resend waits for the next window of
+ * the instance, so an answer to it can't end up in the window of another.
+ * A device dropped by its owner keeps talking until its query timeout,
+ * so its device id is not offered to discovery for a while either.
+ *
+ * Instances can be updated all at once by the host, or by the bus itself
+ * (tbcm_360_3000_he_dri_bus_update). Then the bus keeps deadlines of all
+ * instances in a hierarchical timer wheel and updates only the ones that
+ * are due or have received frames, so idle cost does not grow with the
+ * number of instances. */
+
+/* Maximum number of driver instances per bus */
+#ifndef TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES
+#define TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES 64U
+#endif
+
+#if (TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES < 1U) || \
+    (TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES > 255U)
+#error "TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES must be in range 1..255"
+#endif
+
+/* TX pacing: bus_read_frame hands out at most that many frames per ms of
+ * bus time, so a burst does not overflow controller TX queue. Frames held
+ * back stay queued in their instances. Token bucket is refilled by
+ * bus_update and holds up to BUS_TX_BURST frames (0 - no limit).
+ * These are defaults of every bus, see bus_set_tx_rate */
+#ifndef TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS
+#define TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS 0U
+#endif
+
+#ifndef TBCM_360_3000_HE_DRI_BUS_TX_BURST
+#define TBCM_360_3000_HE_DRI_BUS_TX_BURST                                    \
+	TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS
+#endif
+
+#if (TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS > 255U) ||                    \
+    (TBCM_360_3000_HE_DRI_BUS_TX_BURST > 255U) ||                            \
+    (TBCM_360_3000_HE_DRI_BUS_TX_BURST <                                     \
+     TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS)
+#error "TBCM_360_3000_HE_DRI_BUS_TX_BURST must be in range FRAMES_PER_MS..255"
+#endif
+
+/* Timer wheel: 3 levels of 64 slots, 1ms, 64ms and 4096ms per slot.
+ * Longer deadlines are cut to the wheel span (instance is updated early
+ * and its deadline is taken again) */
+#define TBCM_360_3000_HE_DRI_BUS_WHEEL_SLOTS   64U
+#define TBCM_360_3000_HE_DRI_BUS_WHEEL_LEVELS  3U
+#define TBCM_360_3000_HE_DRI_BUS_WHEEL_SPAN_MS 262143UL
+
+/* Wheel list of instances to be updated right away, none */
+#define TBCM_360_3000_HE_DRI_BUS_SLOT_READY                                  \
+	(TBCM_360_3000_HE_DRI_BUS_WHEEL_SLOTS *                              \
+	 TBCM_360_3000_HE_DRI_BUS_WHEEL_LEVELS)
+#define TBCM_360_3000_HE_DRI_BUS_SLOT_NONE     0xFFU
+#define TBCM_360_3000_HE_DRI_BUS_INDEX_NONE    0xFFU
+
+/* Device ids dropped by their owners are held back from discovery for
+ * 2..3 periods of bus time, longer than devices talk without queries */
+#define TBCM_360_3000_HE_DRI_BUS_LOST_PERIOD_MS                              \
+	(TBCM_360_3000_HE_DRI_LINK_TIMEOUT_MS / 2U)
+#define TBCM_360_3000_HE_DRI_BUS_LOST_BANKS    3U
+
+/* RAM budget of the bus manager in bytes (sizeof, enforced by the test).
+ * Wheel takes 11 bytes per instance */
+#define TBCM_360_3000_HE_DRI_BUS_SIZE_BUDGET                                 \
+	((TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES *                           \
+	  (TBCM_360_3000_HE_DRI_SIZE_BUDGET + 11U)) + 584U)
+
+struct tbcm_360_3000_he_dri_bus {
+	struct tbcm_360_3000_he_dri
+			      dri[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+	uint8_t count; /* Number of instances in use */
+
+	/* Device id -> (instance index + 1), zero if owner is unknown.
+	 * Entries are validated on every use, so stale ones are harmless */
+	uint8_t owner[256U];
+
+	uint8_t  tx_next; /* Round robin index for TX */
+
+	/* TX pacing (used if tx_rate > 0) */
+	uint8_t  tx_rate;   /* Frames per ms of bus time */
+	uint8_t  tx_burst;  /* Token bucket size */
+	uint8_t  tx_tokens; /* Frames that can be sent right now */
+	bool     tx_held;   /* Bucket ran empty, frames may be held back */
+
+	/* Instance that has its device query on the bus (INDEX_NONE - none)
+	 * and its time_up when the query window was opened (see time_up) */
+	uint8_t  discovering;
+	uint32_t discovery_ms;
+
+	/* Lost device ids (bitmaps), one bank per period, oldest one is
+	 * cleared and reused when bus time passes lost_ms + period */
+	uint8_t  lost[TBCM_360_3000_HE_DRI_BUS_LOST_BANKS][256U / 8U];
+	uint8_t  lost_bank;
+	uint32_t lost_ms;
+
+	uint32_t dropped;  /* RX frames no instance was interested in */
+	uint32_t rejected; /* RX frames an instance it was routed to could
+			    * not take (its RX queue was full) */
+
+	/* Timer wheel (used by bus_update only). Every instance is linked
+	 * into at most one slot list, or into READY list */
+	uint32_t now_ms; /* Bus time */
+	uint16_t scheduled; /* Instances in wheel slots (not READY) */
+	uint8_t  levels[TBCM_360_3000_HE_DRI_BUS_WHEEL_LEVELS]; /* Per level */
+
+	uint8_t  heads[TBCM_360_3000_HE_DRI_BUS_SLOT_READY + 1U];
+	uint8_t  next[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+	uint8_t  prev[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+	uint8_t  slot[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+
+	uint32_t expires_ms[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES];
+	uint32_t last_ms[TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES]; /* Updated */
+};
+
+/* Private */
+
+/* Instance is bound if it has accepted device id and reads its data
+ * (or tries to get it back after link loss) */
+bool _tbcm_360_3000_he_dri_bus_is_owner(struct tbcm_360_3000_he_dri *dri,
+					uint8_t device_id)
+{
+	return ((dri->_state == (uint8_t)TBCM_360_3000_HE_DRI_STATE_ACK_ID) ||
+		(dri->_state ==
+		 (uint8_t)TBCM_360_3000_HE_DRI_STATE_ESTABLISHED) ||
+		(dri->_state ==
+		 (uint8_t)TBCM_360_3000_HE_DRI_STATE_RECONNECT)) &&
+	       (dri->_device_id == device_id);
+}
+
+/* Uptime of instance including bus time it has not been updated for yet
+ * (instance sleeping in timer wheel lags behind) */
+uint32_t _tbcm_360_3000_he_dri_bus_time_up_ms(
+				       struct tbcm_360_3000_he_dri_bus *self,
+				       uint8_t index)
+{
+	return self->dri[index]._time_up_ms +
+	       (self->now_ms - self->last_ms[index]);
+}
+
+/* Instance whose query window is open (INDEX_NONE - none). Window is
+ * closed once the instance is done with querying or has waited a whole
+ * query interval for an answer */
+uint8_t _tbcm_360_3000_he_dri_bus_discovering(
+				       struct tbcm_360_3000_he_dri_bus *self)
+{
+	struct tbcm_360_3000_he_dri *dri;
+	uint32_t elapsed;
+
+	if (self->discovering != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		dri     = &self->dri[self->discovering];
+		elapsed = _tbcm_360_3000_he_dri_bus_time_up_ms(self,
+							self->discovering) -
+			  self->discovery_ms;
+
+		if ((dri->_state !=
+		     (uint8_t)TBCM_360_3000_HE_DRI_STATE_QUERY_DEVICE) ||
+		    (elapsed >=
+		     TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS)) {
+			self->discovering =
+					   TBCM_360_3000_HE_DRI_BUS_INDEX_NONE;
+		}
+	}
+
+	return self->discovering;
+}
+
+/* Device id was dropped by its owner lately */
+bool _tbcm_360_3000_he_dri_bus_is_lost(struct tbcm_360_3000_he_dri_bus *self,
+				       uint8_t device_id)
+{
+	uint8_t mask = (uint8_t)(1U << (device_id & 7U));
+	bool    lost = false;
+	uint8_t i;
+
+	for (i = 0U; i < TBCM_360_3000_HE_DRI_BUS_LOST_BANKS; i++) {
+		lost = lost || ((self->lost[i][device_id >> 3U] & mask) > 0U);
+	}
+
+	return lost;
+}
+
+/* Timer wheel */
+
+void _tbcm_360_3000_he_dri_bus_unlink(struct tbcm_360_3000_he_dri_bus *self,
+				      uint8_t index)
+{
+	uint8_t slot = self->slot[index];
+
+	if (slot != TBCM_360_3000_HE_DRI_BUS_SLOT_NONE) {
+		if (self->prev[index] != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+			self->next[self->prev[index]] = self->next[index];
+		} else {
+			self->heads[slot] = self->next[index];
+		}
+
+		if (self->next[index] != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+			self->prev[self->next[index]] = self->prev[index];
+		}
+
+		if (slot != TBCM_360_3000_HE_DRI_BUS_SLOT_READY) {
+			self->scheduled--;
+			self->levels[slot >> 6U]--;
+		}
+
+		self->slot[index] = TBCM_360_3000_HE_DRI_BUS_SLOT_NONE;
+	}
+}
+
+void _tbcm_360_3000_he_dri_bus_link(struct tbcm_360_3000_he_dri_bus *self,
+				    uint8_t index, uint8_t slot)
+{
+	uint8_t head = self->heads[slot];
+
+	self->prev[index] = TBCM_360_3000_HE_DRI_BUS_INDEX_NONE;
+	self->next[index] = head;
+
+	if (head != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		self->prev[head] = index;
+	}
+
+	self->heads[slot] = index;
+	self->slot[index] = slot;
+
+	if (slot != TBCM_360_3000_HE_DRI_BUS_SLOT_READY) {
+		self->scheduled++;
+		self->levels[slot >> 6U]++;
+	}
+}
+
+/* (Re)schedule instance to be updated in delay_ms
+ * (0 - right away, DEADLINE_NONE - only when woken) */
+void _tbcm_360_3000_he_dri_bus_schedule(struct tbcm_360_3000_he_dri_bus *self,
+					uint8_t index, uint32_t delay_ms)
+{
+	uint32_t expires;
+	uint8_t  slot;
+
+	_tbcm_360_3000_he_dri_bus_unlink(self, index);
+
+	if (delay_ms == 0U) {
+		_tbcm_360_3000_he_dri_bus_link(self, index,
+				     TBCM_360_3000_HE_DRI_BUS_SLOT_READY);
+	} else if (delay_ms != TBCM_360_3000_HE_DRI_DEADLINE_NONE) {
+		if (delay_ms > TBCM_360_3000_HE_DRI_BUS_WHEEL_SPAN_MS) {
+			delay_ms = TBCM_360_3000_HE_DRI_BUS_WHEEL_SPAN_MS;
+		}
+
+		/* Level is chosen by distance, slot by expiry time itself,
+		 * so the slot is reached (or cascaded) exactly in time */
+		expires = self->now_ms + delay_ms;
+
+		if (delay_ms < 64U) {
+			slot = (uint8_t)(expires & 63U);
+		} else if (delay_ms < 4096U) {
+			slot = (uint8_t)(64U + ((expires >> 6U) & 63U));
+		} else {
+			slot = (uint8_t)(128U + ((expires >> 12U) & 63U));
+		}
+
+		self->expires_ms[index] = expires;
+		_tbcm_360_3000_he_dri_bus_link(self, index, slot);
+	} else {}
+}
+
+/* Instance goes to READY list (unless it's there already) */
+void _tbcm_360_3000_he_dri_bus_wake(struct tbcm_360_3000_he_dri_bus *self,
+				    uint8_t index)
+{
+	if (self->slot[index] != TBCM_360_3000_HE_DRI_BUS_SLOT_READY) {
+		_tbcm_360_3000_he_dri_bus_schedule(self, index, 0U);
+	}
+}
+
+/* Move instances of higher level slot down to where they belong now */
+void _tbcm_360_3000_he_dri_bus_cascade(struct tbcm_360_3000_he_dri_bus *self,
+				       uint8_t slot)
+{
+	uint8_t index;
+
+	while (self->heads[slot] != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		index = self->heads[slot];
+		_tbcm_360_3000_he_dri_bus_schedule(self, index,
+				     self->expires_ms[index] - self->now_ms);
+	}
+}
+
+/* Advance wheel by 1ms, instances that expire go to READY list */
+void _tbcm_360_3000_he_dri_bus_tick(struct tbcm_360_3000_he_dri_bus *self)
+{
+	uint8_t slot;
+
+	self->now_ms++;
+	slot = (uint8_t)(self->now_ms & 63U);
+
+	if (slot == 0U) {
+		if (((self->now_ms >> 6U) & 63U) == 0U) {
+			_tbcm_360_3000_he_dri_bus_cascade(self, (uint8_t)
+				(128U + ((self->now_ms >> 12U) & 63U)));
+		}
+
+		_tbcm_360_3000_he_dri_bus_cascade(self, (uint8_t)
+			(64U + ((self->now_ms >> 6U) & 63U)));
+	}
+
+	while (self->heads[slot] != TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		_tbcm_360_3000_he_dri_bus_schedule(self, self->heads[slot], 0U);
+	}
+}
+
+/* Advance wheel by delta_ms. It ticks 1ms at a time only while level 0
+ * has instances, otherwise it jumps right to the next cascade (64ms, or
+ * 4096ms if level 1 is empty too), so a long delta costs a tick per
+ * cascade at most */
+void _tbcm_360_3000_he_dri_bus_advance(struct tbcm_360_3000_he_dri_bus *self,
+				       uint32_t delta_ms)
+{
+	uint32_t step;
+
+	while ((delta_ms > 0U) && (self->scheduled > 0U)) {
+		if (self->levels[0] > 0U) {
+			step = 1U;
+		} else if (self->levels[1] > 0U) {
+			step = 64U - (self->now_ms & 63U);
+		} else {
+			step = 4096U - (self->now_ms & 4095U);
+		}
+
+		if (step > delta_ms) {
+			step = delta_ms; /* Cascade is not reached */
+			self->now_ms += step;
+		} else {
+			self->now_ms += step - 1U;
+			_tbcm_360_3000_he_dri_bus_tick(self);
+		}
+
+		delta_ms -= step;
+	}
+
+	self->now_ms += delta_ms; /* Nothing to tick for when wheel is empty */
+}
+
+/* Write frame to instance and wake it. A full RX queue is counted as
+ * rejection, instance is not woken for nothing then */
+bool _tbcm_360_3000_he_dri_bus_deliver(
+			       struct tbcm_360_3000_he_dri_bus *self,
+			       uint8_t index,
+			       struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool accepted = tbcm_360_3000_he_dri_write_frame(&self->dri[index],
+							 frame);
+
+	if (accepted) {
+		_tbcm_360_3000_he_dri_bus_wake(self, index);
+	} else {
+		self->rejected++;
+	}
+
+	return accepted;
+}
+
+/* Route data frame (0x353 - 0x355) by device id from data[0] */
+bool _tbcm_360_3000_he_dri_bus_route_data(
+			       struct tbcm_360_3000_he_dri_bus *self,
+			       struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool    accepted  = false;
+	uint8_t device_id = frame->data[0];
+	uint8_t index     = self->owner[device_id];
+	uint8_t discovering;
+	uint8_t i;
+
+	/* Fast path, owner is known */
+	if ((index > 0U) &&
+	    _tbcm_360_3000_he_dri_bus_is_owner(&self->dri[index - 1U],
+					       device_id)) {
+		accepted = _tbcm_360_3000_he_dri_bus_deliver(self,
+							     index - 1U, frame);
+	} else {
+		/* Owner is unknown or stale. Look it up (happens once per
+		 * binding) or offer frame to the instance that has queried
+		 * its device */
+		self->owner[device_id] = 0U;
+
+		for (i = 0U; i < self->count; i++) {
+			if (_tbcm_360_3000_he_dri_bus_is_owner(&self->dri[i],
+							       device_id)) {
+				self->owner[device_id] = i + 1U;
+				accepted = _tbcm_360_3000_he_dri_bus_deliver(
+							     self, i, frame);
+				break;
+			}
+		}
+
+		/* Bus time does not run if instances are updated by the
+		 * host, lost ids can't be held back then */
+		if ((index > 0U) && (self->owner[device_id] == 0U) &&
+		    (self->now_ms != 0U)) {
+			self->lost[self->lost_bank][device_id >> 3U] |=
+				      (uint8_t)(1U << (device_id & 7U));
+		}
+
+		discovering = _tbcm_360_3000_he_dri_bus_discovering(self);
+
+		if ((self->owner[device_id] == 0U) && (discovering !=
+				       TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) &&
+		    !_tbcm_360_3000_he_dri_bus_is_lost(self, device_id)) {
+			accepted = _tbcm_360_3000_he_dri_bus_deliver(self,
+							discovering, frame);
+		}
+	}
+
+	return accepted;
+}
+
+/* Route serial number broadcast (0x350) to instances listening for devices */
+bool _tbcm_360_3000_he_dri_bus_route_serial_no(
+			       struct tbcm_360_3000_he_dri_bus *self,
+			       struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool    accepted = false;
+	uint8_t i;
+
+	for (i = 0U; i < self->count; i++) {
+		if (self->dri[i]._state ==
+		    (uint8_t)TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES) {
+			accepted |= _tbcm_360_3000_he_dri_bus_deliver(self, i,
+								      frame);
+		}
+	}
+
+	return accepted;
+}
+
+/* Public */
+
+/* Initialize bus with count driver instances (clamped to maximum) */
+void tbcm_360_3000_he_dri_bus_init(struct tbcm_360_3000_he_dri_bus *self,
+				   uint8_t count)
+{
+	uint8_t i;
+
+	self->count = count;
+
+	/* Any uint8_t count fits if maximum is 255 */
+#if TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES < 255U
+	if (self->count > TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES) {
+		self->count = TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES;
+	}
+#endif
+
+	(void)memset(self->owner, 0U, sizeof(self->owner));
+
+	self->tx_next  = 0U;
+	self->dropped  = 0U;
+	self->rejected = 0U;
+
+	self->tx_rate   = (uint8_t)TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS;
+	self->tx_burst  = (uint8_t)TBCM_360_3000_HE_DRI_BUS_TX_BURST;
+	self->tx_tokens = self->tx_burst;
+	self->tx_held   = false;
+
+	self->discovering  = TBCM_360_3000_HE_DRI_BUS_INDEX_NONE;
+	self->discovery_ms = 0U;
+
+	(void)memset(self->lost, 0U, sizeof(self->lost));
+	self->lost_bank = 0U;
+	self->lost_ms   = 0U;
+
+	/* Every instance gets its first update right away */
+	self->now_ms    = 0U;
+	self->scheduled = 0U;
+	(void)memset(self->levels, 0U, sizeof(self->levels));
+	(void)memset(self->heads, TBCM_360_3000_HE_DRI_BUS_INDEX_NONE,
+		     sizeof(self->heads));
+
+	for (i = 0U; i < self->count; i++) {
+		tbcm_360_3000_he_dri_init(&self->dri[i]);
+
+		self->slot[i]    = TBCM_360_3000_HE_DRI_BUS_SLOT_NONE;
+		self->last_ms[i] = 0U;
+		_tbcm_360_3000_he_dri_bus_schedule(self, i, 0U);
+
+		/* Periodic frames of instances are spread evenly */
+		tbcm_360_3000_he_dri_set_tx_phase(&self->dri[i], (uint16_t)
+			(((uint32_t)i *
+			  TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS) /
+			 self->count));
+	}
+}
+
+uint8_t tbcm_360_3000_he_dri_bus_get_count(
+					 struct tbcm_360_3000_he_dri_bus *self)
+{
+	return self->count;
+}
+
+/* Get driver instance by index (NULL if out of range) */
+struct tbcm_360_3000_he_dri *tbcm_360_3000_he_dri_bus_get(
+					 struct tbcm_360_3000_he_dri_bus *self,
+					 uint8_t index)
+{
+	struct tbcm_360_3000_he_dri *dri = NULL;
+
+	if (index < self->count) {
+		dri = &self->dri[index];
+	}
+
+	return dri;
+}
+
+/* Set TX pacing (frames per ms of bus time, 0 - no limit) and the number
+ * of frames that can go out at once (at least frames_per_ms). Bucket
+ * starts full */
+void tbcm_360_3000_he_dri_bus_set_tx_rate(
+				 struct tbcm_360_3000_he_dri_bus *self,
+				 uint8_t frames_per_ms, uint8_t burst)
+{
+	if (burst < frames_per_ms) {
+		burst = frames_per_ms;
+	}
+
+	self->tx_rate   = frames_per_ms;
+	self->tx_burst  = burst;
+	self->tx_tokens = burst;
+	self->tx_held   = false;
+}
+
+/* Route RX frame to instance(s) it belongs to.
+ * Returns false if frame was not accepted by any instance, it's counted
+ * as rejected if some instance had no room for it, as dropped otherwise */
+bool tbcm_360_3000_he_dri_bus_write_frame(
+				 struct tbcm_360_3000_he_dri_bus *self,
+				 struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint32_t rejected = self->rejected;
+	bool     accepted = false;
+
+	if ((frame->id == 0x350U) && (frame->len == 6U)) {
+		accepted = _tbcm_360_3000_he_dri_bus_route_serial_no(self,
+								     frame);
+	} else if (((frame->id == 0x353U) || (frame->id == 0x354U) ||
+		    (frame->id == 0x355U)) && (frame->len == 8U)) {
+		accepted = _tbcm_360_3000_he_dri_bus_route_data(self, frame);
+	} else {}
+
+	if (!accepted && (self->rejected == rejected)) {
+		self->dropped++;
+	}
+
+	return accepted;
+}
+
+/* Have instance updated by the next bus_update. Frames routed by the bus
+ * wake their instances by themselves, call it after changing an instance
+ * from outside (ack, settings), so it's handled without waiting for its
+ * next deadline */
+void tbcm_360_3000_he_dri_bus_wake(struct tbcm_360_3000_he_dri_bus *self,
+				   uint8_t index)
+{
+	if (index < self->count) {
+		_tbcm_360_3000_he_dri_bus_wake(self, index);
+	}
+}
+
+/* Advance bus time and update instances that are due (timers) or woken
+ * (frames received, bus_wake), each with time elapsed since its own last
+ * update. Cost depends on the number of updated instances, not on the
+ * number of instances, and on the number of cascades, not on delta.
+ * Instances that wait for a user decision (serial no, device id) are
+ * parked until their own timers, call bus_wake after the ack.
+ * When used, instances must not be updated by the host directly.
+ * Returns number of updates done */
+uint32_t tbcm_360_3000_he_dri_bus_update(struct tbcm_360_3000_he_dri_bus *self,
+					 uint32_t delta_time_ms)
+{
+	struct tbcm_360_3000_he_dri *dri;
+	uint32_t delay;
+	uint32_t t;
+	uint32_t n = 0U;
+	uint8_t  index;
+
+	_tbcm_360_3000_he_dri_bus_advance(self, delta_time_ms);
+
+	/* Oldest bank of lost device ids expires */
+	while ((self->now_ms - self->lost_ms) >=
+	       TBCM_360_3000_HE_DRI_BUS_LOST_PERIOD_MS) {
+		self->lost_ms  += TBCM_360_3000_HE_DRI_BUS_LOST_PERIOD_MS;
+		self->lost_bank = (uint8_t)((self->lost_bank + 1U) %
+				      TBCM_360_3000_HE_DRI_BUS_LOST_BANKS);
+		(void)memset(self->lost[self->lost_bank], 0U,
+			     sizeof(self->lost[0]));
+	}
+
+	if ((self->tx_rate > 0U) && (delta_time_ms > 0U)) {
+		if (delta_time_ms >= self->tx_burst) {
+			self->tx_tokens = self->tx_burst;
+		} else {
+			t = self->tx_tokens + (delta_time_ms * self->tx_rate);
+			if (t > self->tx_burst) {
+				t = self->tx_burst;
+			}
+
+			self->tx_tokens = (uint8_t)t;
+		}
+
+		self->tx_held = false;
+	}
+
+	while (self->heads[TBCM_360_3000_HE_DRI_BUS_SLOT_READY] !=
+	       TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		index = self->heads[TBCM_360_3000_HE_DRI_BUS_SLOT_READY];
+		dri   = &self->dri[index];
+
+		_tbcm_360_3000_he_dri_bus_unlink(self, index);
+		(void)tbcm_360_3000_he_dri_update(dri,
+				       self->now_ms - self->last_ms[index]);
+		self->last_ms[index] = self->now_ms;
+		n++;
+
+		/* Waiting for user decision does not count as due, so such
+		 * instance is parked (DEADLINE_NONE) or runs its timers */
+		delay = tbcm_360_3000_he_dri_next_deadline_ms(dri);
+
+		if (delay == 0U) {
+			delay = 1U;
+		}
+
+		/* Instance may have been woken by a callback meanwhile */
+		if (self->slot[index] == TBCM_360_3000_HE_DRI_BUS_SLOT_NONE) {
+			_tbcm_360_3000_he_dri_bus_schedule(self, index, delay);
+		}
+	}
+
+	return n;
+}
+
+/* Milliseconds until bus_update has something to do, assuming no frames
+ * arrive meanwhile (0 - right now, DEADLINE_NONE - nothing scheduled).
+ * Deadlines further than 64ms are reported at the next wheel cascade */
+uint32_t tbcm_360_3000_he_dri_bus_next_deadline_ms(
+					 struct tbcm_360_3000_he_dri_bus *self)
+{
+	uint32_t deadline = TBCM_360_3000_HE_DRI_DEADLINE_NONE;
+	uint32_t t;
+
+	if (self->heads[TBCM_360_3000_HE_DRI_BUS_SLOT_READY] !=
+	    TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+		deadline = 0U;
+	} else if (self->scheduled > 0U) {
+		/* First due slot before the next cascade */
+		deadline = 64U - (self->now_ms & 63U);
+
+		for (t = 1U; (t < deadline) &&
+		     (self->heads[(self->now_ms + t) & 63U] ==
+		      TBCM_360_3000_HE_DRI_BUS_INDEX_NONE); t++) {}
+
+		deadline = t;
+	} else {}
+
+	/* Frames held back by pacing go out with the next tokens */
+	if (self->tx_held && (deadline > 1U)) {
+		deadline = 1U;
+	}
+
+	return deadline;
+}
+
+/* Get next frame to be sent by any instance (round robin).
+ * Call until it returns false. With TX pacing it also returns false when
+ * the bus is out of tokens, the rest is sent after next bus_update.
+ * Device queries of other instances are held back while a query window
+ * is open (see BUS MANAGER) */
+bool tbcm_360_3000_he_dri_bus_read_frame(
+				 struct tbcm_360_3000_he_dri_bus *self,
+				 struct tbcm_360_3000_he_dri_frame *frame)
+{
+	struct tbcm_360_3000_he_dri *dri;
+	bool    has_frame   = false;
+	uint8_t count       = self->count;
+	uint8_t discovering = _tbcm_360_3000_he_dri_bus_discovering(self);
+	uint8_t i;
+
+	if ((self->tx_rate > 0U) && (self->tx_tokens == 0U)) {
+		self->tx_held = true;
+		count         = 0U;
+	}
+
+	for (i = 0U; (i < count) && !has_frame; i++) {
+		dri = &self->dri[self->tx_next];
+
+		if (dri->_state !=
+		    (uint8_t)TBCM_360_3000_HE_DRI_STATE_QUERY_DEVICE) {
+			has_frame = tbcm_360_3000_he_dri_read_frame(dri,
+								    frame);
+		} else if (discovering ==
+			   TBCM_360_3000_HE_DRI_BUS_INDEX_NONE) {
+			has_frame = tbcm_360_3000_he_dri_read_frame(dri,
+								    frame);
+
+			/* Query opens the window, resends of the instance
+			 * are held back until it's closed */
+			if (has_frame) {
+				self->discovering  = self->tx_next;
+				self->discovery_ms =
+				   _tbcm_360_3000_he_dri_bus_time_up_ms(self,
+								self->tx_next);
+			}
+		} else {}
+
+		self->tx_next++;
+		if (self->tx_next >= self->count) {
+			self->tx_next = 0U;
+		}
+	}
+
+	if ((self->tx_rate > 0U) && has_frame) {
+		self->tx_tokens--;
+	}
+
+	return has_frame;
+}
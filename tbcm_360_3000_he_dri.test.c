@@ -2,8 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Number of log calls made by the driver */
+unsigned long log_calls;
+
 #define TBCM_360_3000_HE_DRI_LOG(v) {printf("\x1b" "[1;33m");\
-				     printf v; printf("\x1b" "[0m");}
+				     printf v; printf("\x1b" "[0m");\
+				     log_calls++;}
+#define TBCM_360_3000_HE_DRI_TRACE_SIZE 16U
+#define TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS 2U
+#define TBCM_360_3000_HE_DRI_BUS_TX_BURST 4U
 #include "tbcm_360_3000_he_dri.h"
 
 struct tbcm_360_3000_he_dri dri;
@@ -11,6 +18,17 @@ struct tbcm_360_3000_he_dri dri;
 /* Snapshot to reset dri to previous state */
 struct tbcm_360_3000_he_dri dri_snapshot;
 
+/* Memory footprint budget (compile time, array size turns negative) */
+typedef char check_size_budget[(sizeof(struct tbcm_360_3000_he_dri) <=
+				TBCM_360_3000_HE_DRI_SIZE_BUDGET) ? 1 : -1];
+typedef char check_bus_size_budget[(sizeof(struct tbcm_360_3000_he_dri_bus) <=
+				  TBCM_360_3000_HE_DRI_BUS_SIZE_BUDGET) ? 1 : -1];
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+typedef char check_counters_size[
+		((sizeof(struct tbcm_360_3000_he_dri_counters) + 4U) ==
+		 TBCM_360_3000_HE_DRI_SIZE_COUNTERS) ? 1 : -1];
+#endif
+
 /*#define assert(s)							      \
 do {									      \
 	if (!(s)) {							      \
@@ -39,15 +57,995 @@ void check_data_no_timeout(struct tbcm_360_3000_he_dri *dri,
 					      TBCM_360_3000_HE_DRI_EVENT_NONE);
 }
 
+void check_data_burst(struct tbcm_360_3000_he_dri *dri,
+		      struct tbcm_360_3000_he_dri_frame *frame)
+{
+	assert(tbcm_360_3000_he_dri_update(dri, 4999U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	frame->id  = 0x353U;
+	assert(tbcm_360_3000_he_dri_write_frame(dri, frame) == true);
+	frame->id  = 0x354U;
+	assert(tbcm_360_3000_he_dri_write_frame(dri, frame) == true);
+	frame->id  = 0x355U;
+	assert(tbcm_360_3000_he_dri_write_frame(dri, frame) == true);
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(dri->_reader.link_timer_ms == 0U);
+}
+
+void check_batch_io(struct tbcm_360_3000_he_dri *dri)
+{
+	struct tbcm_360_3000_he_dri_frame
+			  frames[TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE + 2U];
+	uint32_t overflows = tbcm_360_3000_he_dri_get_rx_overflows(dri);
+	uint32_t i;
+
+	/* Batch bigger than RX queue, excess must be counted as overflow */
+	for (i = 0U; i < (TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE + 2U); i++) {
+		frames[i].id  = 0x353U + (i % 3U);
+		frames[i].len = 8U;
+		(void)memset(frames[i].data, 0U, 8U);
+		frames[i].data[0] = tbcm_360_3000_he_dri_get_device_id(dri);
+	}
+
+	assert(tbcm_360_3000_he_dri_write_frames(dri, frames,
+				TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE + 2U) ==
+					   TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE);
+	assert(tbcm_360_3000_he_dri_get_rx_overflows(dri) == (overflows + 2U));
+
+	/* Everything accepted is processed within single update */
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(dri->_reader.queue.count == 0U);
+	assert(dri->_reader.link_timer_ms == 0U);
+
+	/* Batch egress */
+	dri->_writer.serial_no_timer_ms =
+			       TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS;
+	dri->_writer.settings_timer_ms =
+				      TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS;
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(tbcm_360_3000_he_dri_read_frames(dri, frames, 1U) == 1U);
+	assert(frames[0].id == 0x352U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(tbcm_360_3000_he_dri_read_frames(dri, frames, 4U) == 1U);
+	assert(frames[0].id == 0x351U);
+	assert(tbcm_360_3000_he_dri_read_frames(dri, frames, 4U) == 0U);
+}
+
+/* Discover device on the bus by the first listening instance */
+void bus_discover(struct tbcm_360_3000_he_dri_bus *bus, uint8_t index,
+		  uint8_t serial_lsb, uint8_t device_id)
+{
+	struct tbcm_360_3000_he_dri_frame frame = {
+		0x350U, 6U, { 0x01U, 0x23U, 0x45U, 0x67U, 0x89U, 0x00U }
+	};
+	struct tbcm_360_3000_he_dri_frame query;
+	struct tbcm_360_3000_he_dri *dri;
+	uint8_t i;
+
+	frame.data[5] = serial_lsb;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(bus, &frame) == true);
+
+	for (i = 0U; i < tbcm_360_3000_he_dri_bus_get_count(bus); i++) {
+		dri = tbcm_360_3000_he_dri_bus_get(bus, i);
+
+		if (tbcm_360_3000_he_dri_update(dri, 0U) ==
+					TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO) {
+			tbcm_360_3000_he_dri_ack_serial_no(dri, i == index);
+		}
+	}
+
+	/* Query goes out, device answers it */
+	dri = tbcm_360_3000_he_dri_bus_get(bus, index);
+	(void)tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_bus_read_frame(bus, &query)) {}
+	assert(bus->discovering == index);
+
+	frame.id      = 0x353U;
+	frame.len     = 8U;
+	frame.data[0] = device_id;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(bus, &frame) == true);
+
+	dri = tbcm_360_3000_he_dri_bus_get(bus, index);
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID);
+	tbcm_360_3000_he_dri_accept_device_id(dri);
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+				       TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED);
+}
+
+void check_bus(void)
+{
+	static struct tbcm_360_3000_he_dri_bus bus;
+	struct tbcm_360_3000_he_dri_frame frame = { 0x353U, 8U, { 0U } };
+	char    serial_no[2][(6U * 2U) + 1U];
+	uint8_t i;
+
+	tbcm_360_3000_he_dri_bus_init(&bus, 3U);
+	assert(tbcm_360_3000_he_dri_bus_get(&bus, 3U) == NULL);
+
+	bus_discover(&bus, 0U, 0x01U, 5U);
+	bus_discover(&bus, 1U, 0x02U, 6U);
+
+	/* Serial nos of both instances can be used at once */
+	assert(strcmp(tbcm_360_3000_he_dri_format_serial_no(&bus.dri[0],
+							    serial_no[0]),
+		      tbcm_360_3000_he_dri_format_serial_no(&bus.dri[1],
+							    serial_no[1])) < 0);
+
+	/* Unknown frames and unknown device ids go nowhere */
+	frame.id = 0x123U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+	frame.id = 0x353U;
+	frame.data[0] = 7U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+	assert(bus.dropped == 2U);
+
+	/* Data frames are delivered to their owner only */
+	for (i = 0U; i < 3U; i++) {
+		frame.data[0] = 5U + (i % 2U);
+		assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	}
+
+	assert(bus.dri[0]._reader.queue.count == 2U);
+	assert(bus.dri[1]._reader.queue.count == 1U);
+	assert(bus.dri[2]._reader.queue.count == 0U);
+	assert(bus.owner[5U] == 1U);
+	assert(bus.owner[6U] == 2U);
+
+	/* Owner with full RX queue rejects frames and is not woken for
+	 * them, on both known and looked up owner path */
+	while (tbcm_360_3000_he_dri_write_frame(&bus.dri[0], &frame)) {}
+	_tbcm_360_3000_he_dri_bus_schedule(&bus, 0U, 10U);
+	frame.data[0] = 5U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+	bus.owner[5U] = 0U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+	assert(bus.slot[0] != TBCM_360_3000_HE_DRI_BUS_SLOT_READY);
+	assert(bus.rejected == 2U);
+	assert(bus.dropped == 2U);
+
+	/* TX from all instances */
+	_tbcm_360_3000_he_dri_writer_send_query(&bus.dri[0]);
+	_tbcm_360_3000_he_dri_writer_send_query(&bus.dri[1]);
+	assert(tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame) == true);
+	assert(tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame) == true);
+	assert(tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame) == false);
+}
+
+/* Read bus frames until query for serial no ending with serial_lsb */
+bool bus_read_query(struct tbcm_360_3000_he_dri_bus *bus, uint8_t serial_lsb)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	bool found = false;
+
+	/* Not testing TX pacing here */
+	bus->tx_tokens = TBCM_360_3000_HE_DRI_BUS_TX_BURST;
+
+	while (!found && tbcm_360_3000_he_dri_bus_read_frame(bus, &frame)) {
+		found = (frame.id == 0x351U) && (frame.data[5] == serial_lsb);
+	}
+
+	return found;
+}
+
+void check_bus_discovery(void)
+{
+	static struct tbcm_360_3000_he_dri_bus bus;
+	struct tbcm_360_3000_he_dri_frame frame = {
+		0x350U, 6U, { 0x01U, 0x23U, 0x45U, 0x67U, 0x89U, 0x00U }
+	};
+	uint8_t i;
+
+	tbcm_360_3000_he_dri_bus_init(&bus, 2U);
+
+	/* Both instances discover their devices at once */
+	for (i = 0U; i < 2U; i++) {
+		frame.data[5] = i + 1U;
+		assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+		assert(tbcm_360_3000_he_dri_update(&bus.dri[i], 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+		tbcm_360_3000_he_dri_accept_serial_no(&bus.dri[i]);
+
+		if (i == 0U) {
+			assert(tbcm_360_3000_he_dri_update(&bus.dri[1], 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+			tbcm_360_3000_he_dri_reject_serial_no(&bus.dri[1]);
+		}
+	}
+
+	(void)tbcm_360_3000_he_dri_update(&bus.dri[0], 0U);
+	(void)tbcm_360_3000_he_dri_update(&bus.dri[1], 0U);
+
+	/* Only one query is on the bus, the other one is held back */
+	assert(bus_read_query(&bus, 0x01U));
+	assert(bus_read_query(&bus, 0x02U) == false);
+	assert(bus.discovering == 0U);
+
+	/* New device id goes to the instance that has queried only */
+	frame.id      = 0x353U;
+	frame.len     = 8U;
+	frame.data[0] = 5U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	assert(bus.dri[1]._reader.queue.count == 0U);
+	assert(tbcm_360_3000_he_dri_update(&bus.dri[1], 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(tbcm_360_3000_he_dri_update(&bus.dri[0], 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID);
+	assert(tbcm_360_3000_he_dri_get_device_id(&bus.dri[0]) == 5U);
+	tbcm_360_3000_he_dri_accept_device_id(&bus.dri[0]);
+	assert(tbcm_360_3000_he_dri_update(&bus.dri[0], 0U) ==
+				       TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED);
+
+	/* Bound instance closes the window, the held query goes out */
+	assert(bus_read_query(&bus, 0x02U));
+	assert(bus.discovering == 1U);
+
+	/* One query per window, answer to a resend could show up after the
+	 * window is closed */
+	_tbcm_360_3000_he_dri_writer_send_query(&bus.dri[1]);
+	assert(bus_read_query(&bus, 0x02U) == false);
+	assert(bus.discovering == 1U);
+
+	/* Window is closed after query interval without answer */
+	(void)tbcm_360_3000_he_dri_update(&bus.dri[1],
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+	frame.data[0] = 6U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+	assert(bus.discovering == TBCM_360_3000_HE_DRI_BUS_INDEX_NONE);
+
+	/* Until the next query */
+	assert(bus_read_query(&bus, 0x02U));
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	assert(tbcm_360_3000_he_dri_update(&bus.dri[1], 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID);
+	assert(tbcm_360_3000_he_dri_get_device_id(&bus.dri[1]) == 6U);
+	assert(bus.dri[0]._reader.queue.count == 0U);
+	tbcm_360_3000_he_dri_accept_device_id(&bus.dri[1]);
+
+	/* Device dropped by its owner may still talk on its own, it's not
+	 * offered to discovery until that's over (needs bus time) */
+	frame.data[0] = 5U;
+	bus.now_ms    = 1U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	tbcm_360_3000_he_dri_recover_from_fault(&bus.dri[0]);
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+
+	frame.id      = 0x350U;
+	frame.len     = 6U;
+	frame.data[5] = 0x03U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	assert(tbcm_360_3000_he_dri_update(&bus.dri[0], 0U) ==
+					 TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+	tbcm_360_3000_he_dri_accept_serial_no(&bus.dri[0]);
+	(void)tbcm_360_3000_he_dri_update(&bus.dri[0], 0U);
+	assert(bus_read_query(&bus, 0x03U));
+
+	frame.id      = 0x353U;
+	frame.len     = 8U;
+	frame.data[0] = 5U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame) == false);
+
+	(void)tbcm_360_3000_he_dri_bus_update(&bus,
+			 TBCM_360_3000_HE_DRI_BUS_LOST_BANKS *
+			 TBCM_360_3000_HE_DRI_BUS_LOST_PERIOD_MS);
+	assert(bus_read_query(&bus, 0x03U));
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+}
+
+void check_bus_wheel(void)
+{
+	static struct tbcm_360_3000_he_dri_bus bus;
+	struct tbcm_360_3000_he_dri_event_record rec;
+	struct tbcm_360_3000_he_dri_event_record twin_rec;
+	struct tbcm_360_3000_he_dri_frame frame = { 0x353U, 8U, { 5U } };
+	struct tbcm_360_3000_he_dri twin;
+	uint32_t d[2];
+	uint32_t t;
+	uint8_t  index;
+
+	tbcm_360_3000_he_dri_bus_init(&bus, 3U);
+
+	/* Everyone gets the first update, listening instances sleep */
+	assert(tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus) == 0U);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 3U);
+	assert(tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus) ==
+					 TBCM_360_3000_HE_DRI_DEADLINE_NONE);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 1000U) == 0U);
+
+	/* Discovery wakes instances it has offered frames to */
+	bus_discover(&bus, 0U, 0x01U, 5U);
+	bus_discover(&bus, 1U, 0x02U, 6U);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 3U);
+
+	/* Not testing TX pacing here, queries of discovery took the tokens */
+	bus.tx_tokens = TBCM_360_3000_HE_DRI_BUS_TX_BURST;
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {}
+
+	/* Sleeping until bus deadlines wakes established instances exactly
+	 * at their own deadline, nothing is done before */
+	d[0]  = tbcm_360_3000_he_dri_next_deadline_ms(&bus.dri[0]);
+	d[1]  = tbcm_360_3000_he_dri_next_deadline_ms(&bus.dri[1]);
+	index = (d[1] < d[0]) ? 1U : 0U;
+	t     = bus.now_ms + d[index];
+	assert(tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus) ==
+						     64U - (bus.now_ms & 63U));
+
+	while (tbcm_360_3000_he_dri_bus_update(&bus,
+		      tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus)) == 0U) {
+		assert(bus.now_ms < t);
+	}
+
+	assert(bus.now_ms == t);
+	assert(bus.last_ms[index] == t);
+	assert(bus.dri[index]._time_up_ms == t);
+	assert(tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame) == true);
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {}
+
+	/* Routed frame and bus_wake wake only their instance */
+	frame.id      = 0x353U;
+	frame.len     = 8U;
+	frame.data[0] = 5U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 1U);
+	tbcm_360_3000_he_dri_bus_wake(&bus, 1U);
+	tbcm_360_3000_he_dri_bus_wake(&bus, 1U);
+	tbcm_360_3000_he_dri_bus_wake(&bus, 3U);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 1U);
+
+	/* Events come at the same time as with updating every 1ms (popped
+	 * right away, event queue may be a single slot) */
+	twin = bus.dri[1];
+	t    = bus.now_ms - bus.last_ms[1];
+	twin_rec.event = TBCM_360_3000_HE_DRI_EVENT_NONE;
+
+	for (; t < 7000U; t++) {
+		(void)tbcm_360_3000_he_dri_bus_update(&bus, 1U);
+		(void)tbcm_360_3000_he_dri_update(&twin, 1U);
+
+		while (tbcm_360_3000_he_dri_pop_event(&twin, &twin_rec)) {
+			assert(tbcm_360_3000_he_dri_pop_event(&bus.dri[1],
+							      &rec));
+			assert((rec.event == twin_rec.event) &&
+			       (rec.time_ms == twin_rec.time_ms));
+		}
+
+		assert(tbcm_360_3000_he_dri_pop_event(&bus.dri[1], &rec) ==
+									false);
+	}
+
+	assert(twin_rec.event == TBCM_360_3000_HE_DRI_EVENT_FAULT);
+
+	/* Long delta jumps over empty slots, deadline is still kept */
+	tbcm_360_3000_he_dri_bus_init(&bus, 3U);
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, 0U);
+	_tbcm_360_3000_he_dri_bus_schedule(&bus, 1U, 100000U);
+	t = bus.now_ms + 100000U;
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 99999U) == 0U);
+	assert(bus.slot[1] != TBCM_360_3000_HE_DRI_BUS_SLOT_NONE);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 1U) == 1U);
+	assert(bus.last_ms[1] == t);
+
+	/* Instances waiting for user decision are parked until bus_wake */
+	frame.id      = 0x350U;
+	frame.len     = 6U;
+	frame.data[5] = 0x03U;
+	assert(tbcm_360_3000_he_dri_bus_write_frame(&bus, &frame));
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 3U);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 1000U) == 0U);
+
+	for (index = 0U; index < 3U; index++) {
+		assert(tbcm_360_3000_he_dri_pop_event(&bus.dri[index], &rec));
+		assert(rec.event == TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+		assert(bus.slot[index] == TBCM_360_3000_HE_DRI_BUS_SLOT_NONE);
+	}
+
+	tbcm_360_3000_he_dri_accept_serial_no(&bus.dri[0]);
+	tbcm_360_3000_he_dri_bus_wake(&bus, 0U);
+	assert(tbcm_360_3000_he_dri_bus_update(&bus, 0U) == 1U);
+	assert(bus.dri[0]._state ==
+			    (uint8_t)TBCM_360_3000_HE_DRI_STATE_QUERY_DEVICE);
+}
+
+void check_bus_pacing(void)
+{
+	static struct tbcm_360_3000_he_dri_bus bus;
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint32_t n = 0U;
+	uint8_t  i;
+
+	tbcm_360_3000_he_dri_bus_init(&bus, 8U);
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, 0U);
+
+	/* Periodic frames are spread over query interval */
+	for (i = 0U; i < 8U; i++) {
+		assert(bus.dri[i]._writer.phase_ms == (i * 125U));
+		_tbcm_360_3000_he_dri_writer_send_query(&bus.dri[i]);
+	}
+
+	/* Burst, then frames per ms */
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		n++;
+	}
+
+	assert(n == TBCM_360_3000_HE_DRI_BUS_TX_BURST);
+	assert(tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus) == 1U);
+
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, 0U);
+	assert(tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame) == false);
+
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, 1U);
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		n++;
+	}
+
+	assert(n == (TBCM_360_3000_HE_DRI_BUS_TX_BURST +
+		     TBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS));
+
+	/* Bucket does not grow over its size, held frames are not lost */
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, 1000U);
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		n++;
+	}
+
+	assert(n == 8U);
+	assert(bus.tx_tokens == (TBCM_360_3000_HE_DRI_BUS_TX_BURST - 2U));
+
+	/* Rate set at runtime, burst is never below it */
+	tbcm_360_3000_he_dri_bus_set_tx_rate(&bus, 3U, 1U);
+	assert(bus.tx_burst == 3U);
+
+	for (i = 0U; i < 8U; i++) {
+		_tbcm_360_3000_he_dri_writer_send_query(&bus.dri[i]);
+	}
+
+	n = 0U;
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		n++;
+	}
+
+	assert(n == 3U);
+
+	/* No limit, the rest goes out at once */
+	tbcm_360_3000_he_dri_bus_set_tx_rate(&bus, 0U, 0U);
+	assert(tbcm_360_3000_he_dri_bus_next_deadline_ms(&bus) > 1U);
+
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		n++;
+	}
+
+	assert(n == 8U);
+}
+
+void check_hw_filters(void)
+{
+	struct tbcm_360_3000_he_dri_hw_filter f[4];
+
+	/* Exact cover: 0x350, 0x353 and 0x354-0x355 */
+	assert(tbcm_360_3000_he_dri_get_hw_filters(f, 4U) == 3U);
+	assert(tbcm_360_3000_he_dri_get_hw_filters(f, 3U) == 3U);
+
+	/* Two filters, only 0x351 leaks through */
+	assert(tbcm_360_3000_he_dri_get_hw_filters(f, 2U) == 2U);
+	assert((_tbcm_360_3000_he_dri_hw_filter_size(&f[0]) +
+		_tbcm_360_3000_he_dri_hw_filter_size(&f[1])) == 5U);
+
+	/* Single filter covers 0x350-0x357 */
+	assert(tbcm_360_3000_he_dri_get_hw_filters(f, 1U) == 1U);
+	assert((f[0].code == 0x350U) && (f[0].mask == 0x7F8U));
+
+	assert(tbcm_360_3000_he_dri_get_hw_filters(f, 0U) == 0U);
+
+	assert(tbcm_360_3000_he_dri_get_socketcan_filters(f, 1U) == 1U);
+	assert(f[0].mask == (0x7F8U | TBCM_360_3000_HE_DRI_CAN_EFF_FLAG |
+			     TBCM_360_3000_HE_DRI_CAN_RTR_FLAG));
+}
+
+/* Counts callback invocations per event */
+void count_events(void *ctx, struct tbcm_360_3000_he_dri *dri,
+		  enum tbcm_360_3000_he_dri_event event)
+{
+	uint32_t *counts = (uint32_t *)ctx;
+
+	(void)dri;
+	counts[event]++;
+}
+
+void check_callbacks(struct tbcm_360_3000_he_dri *dri,
+		     struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint32_t counts[TBCM_360_3000_HE_DRI_EVENT_TELEMETRY + 1U] = { 0U };
+
+	tbcm_360_3000_he_dri_set_callback(dri, count_events, counts);
+
+	/* Nothing has changed, nothing is reported */
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(counts[TBCM_360_3000_HE_DRI_EVENT_TELEMETRY] == 0U);
+
+	check_data_no_timeout(dri, frame);
+	check_data_no_timeout(dri, frame);
+	assert(counts[TBCM_360_3000_HE_DRI_EVENT_TELEMETRY] == 2U);
+	assert(counts[TBCM_360_3000_HE_DRI_EVENT_FAULT] == 0U);
+
+	tbcm_360_3000_he_dri_update(dri, 5000U);
+	assert(counts[TBCM_360_3000_HE_DRI_EVENT_FAULT] == 1U);
+
+	tbcm_360_3000_he_dri_set_callback(dri, NULL, NULL);
+}
+
+void check_settings_dirty(struct tbcm_360_3000_he_dri *dri)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &frame)) {}
+
+	/* Changed setpoint goes out on the next update */
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 3000U);
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(dri) == 0U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &frame) == true);
+	assert((frame.id == 0x352U) && (frame.data[4] == 0x0BU) &&
+	       (frame.data[5] == 0xB8U));
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &frame) == false);
+
+	/* Same value again is not a change */
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 3000U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &frame) == false);
+
+	/* Keepalive cadence is kept */
+	tbcm_360_3000_he_dri_update(dri,
+				  TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS);
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &frame) == true);
+	assert(frame.id == 0x352U);
+}
+
+void check_tx_phase(struct tbcm_360_3000_he_dri *dri)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint32_t queries  = 0U;
+	uint32_t settings = 0U;
+	uint32_t t;
+
+	tbcm_360_3000_he_dri_set_link_timeout_ms(dri, 0xFFFFFFFFUL);
+	tbcm_360_3000_he_dri_set_link_missed_periods(dri, 0U);
+	tbcm_360_3000_he_dri_set_tx_phase(dri, 1250U);
+	assert(dri->_writer.phase_ms == 250U);
+
+	/* Both frames due right now, resends are aligned to the phase */
+	dri->_writer.send_settings      = true;
+	dri->_writer.serial_no_timer_ms =
+			      TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS;
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 3100U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &frame)) {}
+
+	for (t = 0U; t < 2000U; t++) {
+		tbcm_360_3000_he_dri_update(dri, 1U);
+
+		while (tbcm_360_3000_he_dri_read_frame(dri, &frame)) {
+			if (frame.id == 0x351U) {
+				assert((dri->_time_up_ms % 1000U) == 250U);
+				queries++;
+			} else {
+				assert((dri->_time_up_ms % 100U) == 25U);
+				settings++;
+			}
+		}
+	}
+
+	assert((queries == 2U) && (settings == 20U));
+
+	/* Long update steps do not drift */
+	tbcm_360_3000_he_dri_update(dri, 1234U);
+	assert(((dri->_time_up_ms + 1000U -
+		 dri->_writer.serial_no_timer_ms) % 1000U) == 250U);
+	assert(((dri->_time_up_ms + 100U -
+		 dri->_writer.settings_timer_ms) % 100U) == 25U);
+
+	/* Without phase interval is counted from the last frame */
+	tbcm_360_3000_he_dri_set_tx_phase(dri,
+				       TBCM_360_3000_HE_DRI_TX_PHASE_NONE);
+	tbcm_360_3000_he_dri_update(dri, 1234U);
+	assert(dri->_writer.serial_no_timer_ms == 0U);
+	assert(dri->_writer.settings_timer_ms == 0U);
+}
+
+void check_fast_link_loss(struct tbcm_360_3000_he_dri *dri,
+			  struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint32_t limit;
+	uint8_t  i;
+	uint8_t  j;
+
+	tbcm_360_3000_he_dri_update(dri, 0U);
+
+	/* Learn 100ms period of every data frame */
+	for (i = 0U; i < 4U; i++) {
+		assert(tbcm_360_3000_he_dri_update(dri, 100U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+
+		for (j = 0U; j < 3U; j++) {
+			frame->id = 0x353U + j;
+			tbcm_360_3000_he_dri_write_frame(dri, frame);
+		}
+	}
+
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(dri->_reader.frame_period_ms[2] == 100U);
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(dri) <= 300U);
+
+	/* Link is degraded after 3 missed periods (0x353 has learned
+	 * longer one from earlier traffic) */
+	assert(tbcm_360_3000_he_dri_update(dri, 299U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(tbcm_360_3000_he_dri_update(dri, 1U) ==
+				     TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED);
+	assert(dri->_reader.degraded == 6U);
+	assert(dri->_state == TBCM_360_3000_HE_DRI_STATE_ESTABLISHED);
+
+	/* Frame that is back is supervised again, the others may stay
+	 * missing (link timeout supervises them) */
+	frame->id = 0x354U;
+	tbcm_360_3000_he_dri_write_frame(dri, frame);
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(dri->_reader.degraded == 4U);
+
+	/* Missing main status frame is reported as well, and the link is
+	 * lost if it stays missing as long again, long before link timeout */
+	limit = dri->_reader.frame_period_ms[0] * 3U;
+	assert(_tbcm_360_3000_he_dri_reader_time_left(dri, 0U) ==
+							       (limit - 300U));
+	assert(tbcm_360_3000_he_dri_update(dri, limit - 300U) ==
+				     TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED);
+	assert(dri->_reader.degraded == 5U);
+	assert(_tbcm_360_3000_he_dri_reader_time_left(dri, 0U) == limit);
+	assert(_tbcm_360_3000_he_dri_reader_time_left(dri, 2U) ==
+					   TBCM_360_3000_HE_DRI_DEADLINE_NONE);
+
+	/* 0x354 that came back is missed again meanwhile */
+	assert(tbcm_360_3000_he_dri_update(dri, limit - 1U) ==
+				     TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED);
+	assert(dri->_reader.degraded == 7U);
+	assert(tbcm_360_3000_he_dri_update(dri, 1U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+}
+
+void check_link_config(struct tbcm_360_3000_he_dri *dri)
+{
+	assert(tbcm_360_3000_he_dri_set_frame_period_ms(dri, 0x352U, 10U) ==
+									false);
+	assert(tbcm_360_3000_he_dri_set_frame_period_ms(dri, 0x353U, 50U) ==
+									 true);
+	tbcm_360_3000_he_dri_set_link_missed_periods(dri, 2U);
+
+	/* 0x353 is queued and seen during the first update */
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(tbcm_360_3000_he_dri_update(dri, 99U) ==
+					      TBCM_360_3000_HE_DRI_EVENT_NONE);
+	assert(tbcm_360_3000_he_dri_update(dri, 1U) ==
+				     TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED);
+	assert(tbcm_360_3000_he_dri_update(dri, 100U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+
+	/* Link timeout is configurable at runtime too */
+	tbcm_360_3000_he_dri_set_frame_period_ms(dri, 0x353U, 0U);
+	tbcm_360_3000_he_dri_set_link_timeout_ms(dri, 1000U);
+	assert(dri->_reader.link_timeout_ms == 1000U);
+}
+
+void check_warm_reconnect(struct tbcm_360_3000_he_dri *dri,
+			  struct tbcm_360_3000_he_dri_frame *frame)
+{
+	struct tbcm_360_3000_he_dri_frame tx;
+
+	tbcm_360_3000_he_dri_set_warm_reconnect(dri, true);
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 3210U);
+
+	/* Link loss is still reported, but discovery is skipped */
+	assert(tbcm_360_3000_he_dri_update(dri, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+	assert(dri->_state == TBCM_360_3000_HE_DRI_STATE_RECONNECT);
+
+	/* Last device is being queried, settings are on hold */
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+	tbcm_360_3000_he_dri_update(dri,
+			     TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS);
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &tx) == true);
+	assert((tx.id == 0x351U) && (tx.data[0] == 0x01U));
+	assert(tbcm_360_3000_he_dri_read_frame(dri, &tx) == false);
+
+	/* Device answers, link is back with the last settings */
+	frame->id = 0x354U;
+	tbcm_360_3000_he_dri_write_frame(dri, frame);
+	assert(tbcm_360_3000_he_dri_update(dri, 0U) ==
+				       TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED);
+	assert(dri->_writer.x352[4] == 0x0CU);
+	assert(dri->_writer.x352[5] == 0x8AU);
+
+	check_data_no_timeout(dri, frame);
+	assert(dri->_writer.send_settings == true);
+
+	/* Device never answers, fall back to discovery */
+	assert(tbcm_360_3000_he_dri_update(dri, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+	assert(dri->_state == TBCM_360_3000_HE_DRI_STATE_RECONNECT);
+	assert(tbcm_360_3000_he_dri_update(dri, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+	assert(dri->_state == TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES);
+}
+
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+void check_counters(struct tbcm_360_3000_he_dri *dri,
+		    struct tbcm_360_3000_he_dri_frame *frame)
+{
+	struct tbcm_360_3000_he_dri_counters c;
+	struct tbcm_360_3000_he_dri_frame tx;
+	struct tbcm_360_3000_he_dri copy;
+	uint8_t i;
+	uint8_t j;
+
+	/* Snapshot has a full RX queue and one overflow */
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert(c.rx_overflows == 1U);
+	tbcm_360_3000_he_dri_reset_counters(dri);
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert((c.rx_accepted == 0U) && (c.rx_overflows == 0U));
+
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+
+	/* Three complete sets 100ms apart (each is processed 100ms later) */
+	for (i = 0U; i < 3U; i++) {
+		tbcm_360_3000_he_dri_update(dri, 100U);
+
+		for (j = 0U; j < 3U; j++) {
+			frame->id = 0x353U + j;
+			tbcm_360_3000_he_dri_write_frame(dri, frame);
+		}
+	}
+
+	tbcm_360_3000_he_dri_update(dri, 100U);
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert(c.rx_accepted == 9U);
+	assert(c.set_interval_max_ms == 100U);
+	assert(c.set_interval_avg_ms == 100U);
+
+	/* Keepalive settings were never read out so far */
+	assert(c.settings_coalesced > 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+	tbcm_360_3000_he_dri_reset_counters(dri);
+
+	/* Data of another device */
+	frame->id      = 0x354U;
+	frame->data[0] = 0x02U;
+	tbcm_360_3000_he_dri_write_frame(dri, frame);
+	frame->data[0] = 0x01U;
+	tbcm_360_3000_he_dri_update(dri, 0U);
+
+	/* Settings changed twice before 0x352 was read out */
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 1234U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	tbcm_360_3000_he_dri_set_voltage_dV(dri, 1235U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert(c.rx_foreign == 1U);
+	assert(c.settings_coalesced == 1U);
+	assert(c.tx_settings == 1U);
+
+	dri->_writer.serial_no_timer_ms =
+			 TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS - 1U;
+	tbcm_360_3000_he_dri_update(dri, 1U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert(c.tx_query == 1U);
+
+	/* Missed frames are counted once, link loss by its cause */
+	copy = *dri;
+	assert(tbcm_360_3000_he_dri_update(dri, 300U) ==
+				     TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED);
+	while (tbcm_360_3000_he_dri_update(dri, 100U) !=
+					    TBCM_360_3000_HE_DRI_EVENT_FAULT) {}
+	tbcm_360_3000_he_dri_get_counters(dri, &c);
+	assert((c.missed_frames == 3U) && (c.link_timeouts == 0U));
+
+	tbcm_360_3000_he_dri_set_link_missed_periods(&copy, 0U);
+	assert(tbcm_360_3000_he_dri_update(&copy, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+	tbcm_360_3000_he_dri_get_counters(&copy, &c);
+	assert((c.missed_frames == 0U) && (c.link_timeouts == 1U));
+}
+#endif
+
+void check_trace(struct tbcm_360_3000_he_dri *dri,
+		 struct tbcm_360_3000_he_dri_frame *frame)
+{
+	uint8_t  buf[(TBCM_360_3000_HE_DRI_TRACE_SIZE + 1U) *
+		     TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE];
+	struct tbcm_360_3000_he_dri_frame tx;
+	uint8_t *r;
+	uint16_t n;
+	uint16_t i;
+	bool     tx_seen = false;
+
+	/* Ring was overrun while snapshot was made, lost records go first */
+	n = tbcm_360_3000_he_dri_trace_dump(dri, buf, sizeof(buf));
+	assert(n == sizeof(buf));
+	assert(buf[6] == TBCM_360_3000_HE_DRI_TRACE_LOST);
+	assert(tbcm_360_3000_he_dri_trace_dump(dri, buf, sizeof(buf)) == 0U);
+
+	/* Snapshot has a full RX queue */
+	while (tbcm_360_3000_he_dri_get_rx_free(dri) <
+	       TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE) {
+		tbcm_360_3000_he_dri_update(dri, 0U);
+	}
+
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+	(void)tbcm_360_3000_he_dri_trace_dump(dri, buf, sizeof(buf));
+
+	/* RX frames, TX frames and fault event */
+	for (i = 0U; i < 3U; i++) {
+		frame->id = 0x353U + i;
+		tbcm_360_3000_he_dri_write_frame(dri, frame);
+	}
+
+	tbcm_360_3000_he_dri_update(dri, 100U);
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	while (tbcm_360_3000_he_dri_read_frame(dri, &tx)) {}
+	assert(tbcm_360_3000_he_dri_update(dri, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+
+	/* Whole records only */
+	assert(tbcm_360_3000_he_dri_trace_dump(dri, buf,
+			    TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE - 1U) == 0U);
+
+	n = tbcm_360_3000_he_dri_trace_dump(dri, buf, sizeof(buf));
+	assert((n >= (5U * TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE)) &&
+	       ((n % TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE) == 0U));
+
+	r = buf;
+	assert(r[6] == TBCM_360_3000_HE_DRI_TRACE_RX);
+	assert((r[4] == 0x53U) && (r[5] == 0x03U));
+	assert(r[7] == frame->len);
+	assert(memcmp(&r[8], frame->data, 8U) == 0);
+
+	for (i = TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE; i < n;
+	     i += TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE) {
+		r = &buf[i];
+
+		if (r[6] == TBCM_360_3000_HE_DRI_TRACE_TX) {
+			tx_seen = true;
+		}
+	}
+
+	/* Fault, then the state it has recovered to. The one before
+	 * is the state fault was detected in */
+	r = &buf[n - (3U * TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE)];
+	assert(tx_seen);
+	assert(r[6] == TBCM_360_3000_HE_DRI_TRACE_STATE);
+	assert((r[8] == TBCM_360_3000_HE_DRI_STATE_ESTABLISHED) &&
+	       (r[9] == TBCM_360_3000_HE_DRI_READER_STATE_TIMEOUT));
+
+	/* Time and line are little endian */
+	r += TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE;
+	assert(r[6] == TBCM_360_3000_HE_DRI_TRACE_EVENT);
+	assert(r[4] == TBCM_360_3000_HE_DRI_EVENT_FAULT);
+	assert(r[7] == 4U);
+	assert((r[0] | (r[1] << 8U) | ((uint32_t)r[2] << 16U) |
+		((uint32_t)r[3] << 24U)) == dri->_time_up_ms);
+	assert((r[8] | (r[9] << 8U)) == dri->_fault_line);
+
+	r += TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE;
+	assert(r[6] == TBCM_360_3000_HE_DRI_TRACE_STATE);
+	assert(r[7] == 2U);
+	assert((r[8] == TBCM_360_3000_HE_DRI_STATE_LISTEN_DEVICES) &&
+	       (r[9] == TBCM_360_3000_HE_DRI_READER_STATE_SERIAL_NO));
+}
+
+void check_log_mask(void)
+{
+	struct tbcm_360_3000_he_dri dri;
+	struct tbcm_360_3000_he_dri_frame frame = {
+		0x350U, 6U, { 0x01U, 0x23U, 0x45U, 0x67U, 0x89U, 0x00U }
+	};
+	unsigned long calls;
+	bool enabled;
+
+	tbcm_360_3000_he_dri_init(&dri);
+	assert(tbcm_360_3000_he_dri_get_log_mask(&dri) ==
+					TBCM_360_3000_HE_DRI_LOG_MASK);
+
+	/* Events only (if compiled in), SERIAL_NO is logged */
+	tbcm_360_3000_he_dri_set_log_mask(&dri,
+					  TBCM_360_3000_HE_DRI_LOG_EVENTS);
+	enabled = tbcm_360_3000_he_dri_get_log_mask(&dri) != 0U;
+	calls   = log_calls;
+	tbcm_360_3000_he_dri_write_frame(&dri, &frame);
+	tbcm_360_3000_he_dri_update(&dri, 2000U);
+	assert(log_calls == (calls + (enabled ? 1U : 0U)));
+
+	/* Nothing */
+	tbcm_360_3000_he_dri_set_log_mask(&dri, 0U);
+	calls   = log_calls;
+	_tbcm_360_3000_he_dri_emit(&dri, TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+	tbcm_360_3000_he_dri_write_frame(&dri, &frame);
+	assert(log_calls == calls);
+
+	/* RX frames only, header, bytes and line end */
+	tbcm_360_3000_he_dri_set_log_mask(&dri, TBCM_360_3000_HE_DRI_LOG_RX);
+	enabled = tbcm_360_3000_he_dri_get_log_mask(&dri) != 0U;
+	calls   = log_calls;
+	tbcm_360_3000_he_dri_write_frame(&dri, &frame);
+	assert(log_calls == (calls + (enabled ? (2U + frame.len) : 0U)));
+
+	/* Categories that are not compiled in can't be enabled */
+	tbcm_360_3000_he_dri_set_log_mask(&dri, 0xFFU);
+	assert(tbcm_360_3000_he_dri_get_log_mask(&dri) ==
+					TBCM_360_3000_HE_DRI_LOG_MASK);
+}
+
+void check_events(struct tbcm_360_3000_he_dri *dri)
+{
+	struct tbcm_360_3000_he_dri_event_record rec;
+	uint32_t overflows;
+
+	while (tbcm_360_3000_he_dri_pop_event(dri, &rec)) {}
+	overflows = tbcm_360_3000_he_dri_get_event_overflows(dri);
+
+	/* ESTABLISHED followed by FAULT within single update */
+	dri->_state = TBCM_360_3000_HE_DRI_STATE_ACK_ID;
+	assert(tbcm_360_3000_he_dri_update(dri, 5000U) ==
+					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
+
+	assert(tbcm_360_3000_he_dri_pop_event(dri, &rec) == true);
+	assert(rec.event == TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED);
+	assert(rec.time_ms == dri->_time_up_ms);
+#if TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE > 1U
+	assert(tbcm_360_3000_he_dri_pop_event(dri, &rec) == true);
+	assert(rec.event == TBCM_360_3000_HE_DRI_EVENT_FAULT);
+#else
+	/* Single slot queue keeps the first one */
+	assert(tbcm_360_3000_he_dri_get_event_overflows(dri) == overflows + 1U);
+	overflows++;
+#endif
+	assert(tbcm_360_3000_he_dri_pop_event(dri, &rec) == false);
+
+	/* Overflow, the oldest events are kept */
+	while (dri->_events.count < TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE) {
+		_tbcm_360_3000_he_dri_emit(dri,
+					  TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+	}
+
+	dri->_state = TBCM_360_3000_HE_DRI_STATE_FAULT;
+	tbcm_360_3000_he_dri_update(dri, 0U);
+	assert(tbcm_360_3000_he_dri_get_event_overflows(dri) == overflows + 1U);
+	assert(tbcm_360_3000_he_dri_pop_event(dri, &rec) == true);
+	assert(rec.event == TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
+}
+
 int main()
 {
 	struct tbcm_360_3000_he_dri_frame frame = {
 		0x350U, 6U,
 		{ 0x01U, 0x23U, 0x45U, 0x67U, 0x89U, 0xABU, 0xCDU, 0xEFU }
 	};
+	struct tbcm_360_3000_he_dri_telemetry telemetry;
+	char serial_no[(6U * 2U) + 1U];
+	uint32_t i;
 
 	tbcm_360_3000_he_dri_init(&dri);
 
+	/* Nothing scheduled until some device is heard */
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(&dri) ==
+					   TBCM_360_3000_HE_DRI_DEADLINE_NONE);
+
 	/* No events at init should occur (maybe?) */
 	assert(tbcm_360_3000_he_dri_update(&dri, 0U) ==
 					TBCM_360_3000_HE_DRI_EVENT_NONE);
@@ -58,10 +1056,10 @@ int main()
 					TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
 
 	printf("Discovered device serial number: %s\n",
-		tbcm_360_3000_he_dri_get_serial_no(&dri));
+		tbcm_360_3000_he_dri_format_serial_no(&dri, serial_no));
 
 	/* Compare serial numbers */
-	assert(strcmp(tbcm_360_3000_he_dri_get_serial_no(&dri),
+	assert(strcmp(tbcm_360_3000_he_dri_format_serial_no(&dri, serial_no),
 		      "0123456789AB") == 0U);
 
 	/* Accept serial number */
@@ -81,7 +1079,10 @@ int main()
 	assert(tbcm_360_3000_he_dri_update(&dri, 0U) ==
 					TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO);
 	printf("Discovered device serial number: %s\n",
-		tbcm_360_3000_he_dri_get_serial_no(&dri));
+		tbcm_360_3000_he_dri_format_serial_no(&dri, serial_no));
+	assert(strcmp(tbcm_360_3000_he_dri_format_serial_no(&dri, serial_no),
+		      "012345678900") == 0U);
+	assert(tbcm_360_3000_he_dri_get_serial_no_raw(&dri)[5] == 0x00U);
 	tbcm_360_3000_he_dri_accept_serial_no(&dri);
 	assert(tbcm_360_3000_he_dri_update(&dri, 0U) == 
 					      TBCM_360_3000_HE_DRI_EVENT_NONE);
@@ -101,7 +1102,9 @@ int main()
 	assert(frame.data[5] == 0x00U);
 
 	/* Must repeat after one scond */
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(&dri) == 1000U);
 	tbcm_360_3000_he_dri_update(&dri, 999);
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(&dri) == 1U);
 	assert(tbcm_360_3000_he_dri_read_frame(&dri, &frame) == false);
 	tbcm_360_3000_he_dri_update(&dri, 1);
 	assert(tbcm_360_3000_he_dri_read_frame(&dri, &frame) == true);
@@ -129,9 +1132,16 @@ int main()
 	/* Check 0x353 was also parsed as valid data frame */
 	assert(dri._reader.rflags == 1U); 
 
-	/* Check busy */
-	assert(tbcm_360_3000_he_dri_write_frame(&dri, &frame) == true);
+	/* Check RX queue overflow */
+	for (i = 0U; i < TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE; i++) {
+		assert(tbcm_360_3000_he_dri_get_rx_free(&dri) ==
+				       (TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE - i));
+		assert(tbcm_360_3000_he_dri_write_frame(&dri, &frame) == true);
+	}
+
+	assert(tbcm_360_3000_he_dri_get_rx_free(&dri) == 0U);
 	assert(tbcm_360_3000_he_dri_write_frame(&dri, &frame) == false);
+	assert(tbcm_360_3000_he_dri_get_rx_overflows(&dri) == 1U);
 
 	/* Check data reception timeout (save snapshot) */
 	dri_snapshot = dri;
@@ -143,6 +1153,38 @@ int main()
 	assert(tbcm_360_3000_he_dri_update(&dri, 1U) == 
 					     TBCM_360_3000_HE_DRI_EVENT_FAULT);
 
+	/* Check event and telemetry callbacks */
+	dri = dri_snapshot;
+	check_callbacks(&dri, &frame);
+
+	/* Check periodic TX aligned to phase */
+	dri = dri_snapshot;
+	check_tx_phase(&dri);
+
+	/* Check link loss detection by missed frame periods */
+	dri = dri_snapshot;
+	check_fast_link_loss(&dri, &frame);
+	dri = dri_snapshot;
+	check_link_config(&dri);
+
+	/* Check warm reconnect after link loss */
+	dri = dri_snapshot;
+	check_warm_reconnect(&dri, &frame);
+
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	/* Check performance and health counters */
+	dri = dri_snapshot;
+	check_counters(&dri, &frame);
+#endif
+
+	/* Check binary trace ring */
+	dri = dri_snapshot;
+	check_trace(&dri, &frame);
+
+	/* Check events queued during single update */
+	dri = dri_snapshot;
+	check_events(&dri);
+
 	/* Check data reception timeout never triggers when all data avail */
 	dri = dri_snapshot;
 	printf("Snapshot loaded\n");
@@ -150,19 +1192,91 @@ int main()
 	check_data_no_timeout(&dri, &frame);
 	check_data_no_timeout(&dri, &frame);
 
+	/* Settings are due first, link timeout is far away */
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(&dri) ==
+			     TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS);
+	tbcm_360_3000_he_dri_write_frame(&dri, &frame);
+	assert(tbcm_360_3000_he_dri_next_deadline_ms(&dri) == 0U);
+	tbcm_360_3000_he_dri_update(&dri, 0U);
+
+	/* Telemetry is decoded once per set and published as a whole */
+	tbcm_360_3000_he_dri_get_telemetry(&dri, &telemetry);
+	assert(telemetry.valid == true);
+	assert(telemetry.seq == 3U);
+	assert(telemetry.out_voltage_dV == 0U);
+	assert(telemetry.out_current_dA == 0x8900U);
+	assert(telemetry.out_temp1_C == 0x23);
+	assert(telemetry.out_temp2_C == 0x45);
+	assert(telemetry.in_voltage_V == 0x89U);
+	assert(tbcm_360_3000_he_dri_get_out_temp1(&dri) == 0x23);
+	assert(tbcm_360_3000_he_dri_get_in_voltage_V(&dri) == 0x89U);
+	assert(tbcm_360_3000_he_dri_get_out_current_dA(&dri) == 0x8900U);
+	assert(tbcm_360_3000_he_dri_get_out_voltage_dV(&dri) == 0U);
+#ifndef TBCM_360_3000_HE_DRI_NO_FLOAT
+	assert(tbcm_360_3000_he_dri_get_out_current_A(&dri) ==
+							   0x8900U / 10.0f);
+#endif
+
+	/* Fixed point setters */
+	tbcm_360_3000_he_dri_set_voltage_dV(&dri, 3505U);
+	tbcm_360_3000_he_dri_set_current_dA(&dri, 200U);
+	assert(dri._writer.x352[4] == 0x0DU);
+	assert(dri._writer.x352[5] == 0xB1U);
+	assert(dri._writer.x352[2] == 0x02U); /* 750 */
+	assert(dri._writer.x352[3] == 0xEEU);
+#ifndef TBCM_360_3000_HE_DRI_NO_FLOAT
+	tbcm_360_3000_he_dri_set_voltage_V(&dri, 350.5f);
+	tbcm_360_3000_he_dri_set_current_A(&dri, 10.0f);
+	assert(dri._writer.x352[4] == 0x0DU);
+	assert(dri._writer.x352[5] == 0xB1U);
+	assert(dri._writer.x352[2] == 0x02U);
+	assert(dri._writer.x352[3] == 0xEEU);
+#endif
+
+	/* Whole burst must be consumed within a single update */
+	dri = dri_snapshot;
+	check_data_burst(&dri, &frame);
+	check_data_burst(&dri, &frame);
+
 	tbcm_360_3000_he_dri_set_defaults(&dri);
 
 	tbcm_360_3000_he_dri_read_frame(&dri, &frame);
-	printf("%i\n", dri._writer.serial_no_timer_ms);
+	assert(dri._writer.serial_no_timer_ms == 0U);
 
 	tbcm_360_3000_he_dri_update(&dri, 0U);
 
-	printf("%i\n", dri._writer.busy);
-	printf("%i\n", dri._writer.serial_no_timer_ms);
+	/* Changed defaults are queued next to the pending query */
+	assert(dri._writer.pending ==
+	       ((1U << (uint8_t)TBCM_360_3000_HE_DRI_TX_SLOT_SETTINGS) |
+		(1U << (uint8_t)TBCM_360_3000_HE_DRI_TX_SLOT_QUERY)));
+	assert(dri._writer.serial_no_timer_ms == 0U);
 
 	tbcm_360_3000_he_dri_read_frame(&dri, &frame);
 	tbcm_360_3000_he_dri_update(&dri, 0U);
 	tbcm_360_3000_he_dri_read_frame(&dri, &frame);
 
+	/* Query and settings due in the same tick, both must be sent,
+	 * settings first */
+	while (tbcm_360_3000_he_dri_read_frame(&dri, &frame)) {}
+	dri._writer.serial_no_timer_ms =
+			 TBCM_360_3000_HE_DRI_SERIAL_NO_QUERY_INTERVAL_MS - 1U;
+	dri._writer.settings_timer_ms =
+				TBCM_360_3000_HE_DRI_SETTINGS_INTERVAL_MS - 1U;
+	tbcm_360_3000_he_dri_update(&dri, 1U);
+	assert(tbcm_360_3000_he_dri_read_frame(&dri, &frame) == true);
+	assert(frame.id == 0x352U);
+	assert(tbcm_360_3000_he_dri_read_frame(&dri, &frame) == true);
+	assert(frame.id == 0x351U);
+	assert(tbcm_360_3000_he_dri_read_frame(&dri, &frame) == false);
+
+	check_settings_dirty(&dri);
+	check_batch_io(&dri);
+	check_bus();
+	check_bus_discovery();
+	check_bus_wheel();
+	check_bus_pacing();
+	check_log_mask();
+	check_hw_filters();
+
 	return 0;
 }
@@ -0,0 +1,568 @@
+/* Host side benchmark of the driver hot paths.
+ *
+ * Every result is a single line of key=value pairs, so the output can be
+ * diffed or compared against a baseline (see bench.sh):
+ *	bench=rx_frame     write_frame + update per data frame (established)
+ *	bench=idle_<state> update without frames, 1ms per tick
+ *	bench=get_<name>   getter cost (inlined, as in single TU builds)
+ *	bench=session      established sessions with simulated devices
+ *			   (tools/sim), driver side only, per instance count
+ *
+ * Timings are taken over batches, state is restored from a snapshot
+ * between batches (outside of timed region), so timeouts never kick in.
+ *
+ * Usage: bench [scale] (iterations are multiplied by scale, default 1)
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../tbcm_360_3000_he_dri.h"
+#include "sim/tbcm_360_3000_he_sim.h"
+
+#define BATCH           100U  /* Ticks between snapshot restores */
+#define SESSION_MAX     4096U
+#define SESSION_BUSES   ((SESSION_MAX + TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES \
+			  - 1U) / TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES)
+#define SESSION_WARM_MS 2000U /* Periods learned, telemetry complete */
+#define SESSION_MS      5000U
+#define FRAMES_PER_STEP 64U
+
+static struct tbcm_360_3000_he_dri established;
+static struct tbcm_360_3000_he_dri dri;
+
+static struct tbcm_360_3000_he_dri_bus buses[SESSION_BUSES];
+static struct tbcm_360_3000_he_sim     sims[SESSION_MAX];
+
+/* Keeps getter results alive */
+static volatile uint32_t sink;
+
+/* Cost of a now_ns() pair as seen by a timed region (time between the
+ * two readings with nothing in between), subtracted from timed regions */
+static double timer_ns;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+static void calibrate(void)
+{
+	double   ns = 0.0;
+	double   t0;
+	uint32_t i;
+
+	for (i = 0U; i < 100000U; i++) {
+		t0  = now_ns();
+		ns += now_ns() - t0;
+	}
+
+	timer_ns = ns / 100000.0;
+}
+
+static void report(const char *name, uint32_t calls, double ns)
+{
+	printf("bench=%s calls=%lu ns_per_call=%.1f\n", name,
+	       (unsigned long)calls, ns / (double)calls);
+}
+
+static void pop_events(struct tbcm_360_3000_he_dri *self)
+{
+	struct tbcm_360_3000_he_dri_event_record record;
+
+	while (tbcm_360_3000_he_dri_pop_event(self, &record)) {}
+}
+
+/* Bind driver to simulated device directly (no claiming logic needed,
+ * every driver gets its own device). Device id comes from the very first
+ * data frames of the device, like it does on real bus */
+static bool establish(struct tbcm_360_3000_he_dri *self,
+		      struct tbcm_360_3000_he_sim *sim)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+
+	frame.id  = 0x350U;
+	frame.len = 6U;
+	(void)memcpy(frame.data, sim->cfg.serial_no, 6U);
+	(void)tbcm_360_3000_he_dri_write_frame(self, &frame);
+	(void)tbcm_360_3000_he_dri_update(self, 0U);
+	tbcm_360_3000_he_dri_accept_serial_no(self);
+
+	/* Query (0x351) makes device talk */
+	(void)tbcm_360_3000_he_dri_update(self, 0U);
+
+	while (tbcm_360_3000_he_dri_read_frame(self, &frame)) {
+		tbcm_360_3000_he_sim_write_frame(sim, &frame);
+	}
+
+	tbcm_360_3000_he_sim_update(sim, 0U);
+
+	while (tbcm_360_3000_he_sim_read_frame(sim, &frame)) {
+		(void)tbcm_360_3000_he_dri_write_frame(self, &frame);
+	}
+
+	(void)tbcm_360_3000_he_dri_update(self, 0U);
+	tbcm_360_3000_he_dri_accept_device_id(self);
+
+	(void)tbcm_360_3000_he_dri_update(self, 0U);
+	pop_events(self);
+
+	tbcm_360_3000_he_dri_set_voltage_dV(self, 2000U);
+	tbcm_360_3000_he_dri_set_current_dA(self, 50U);
+	tbcm_360_3000_he_dri_set_charging_mode(self, 1U);
+
+	return self->_state ==
+	       (uint8_t)TBCM_360_3000_HE_DRI_STATE_ESTABLISHED;
+}
+
+/* Run driver against simulated device until session is warmed up */
+static void prepare_established(void)
+{
+	struct tbcm_360_3000_he_sim_config cfg;
+	struct tbcm_360_3000_he_dri_frame frame;
+	uint32_t t;
+
+	tbcm_360_3000_he_sim_default_config(&cfg, 0U);
+	tbcm_360_3000_he_sim_init(&sims[0], &cfg);
+	tbcm_360_3000_he_dri_init(&established);
+	(void)establish(&established, &sims[0]);
+
+	for (t = 0U; t < SESSION_WARM_MS; t++) {
+		tbcm_360_3000_he_sim_update(&sims[0], 1U);
+
+		while (tbcm_360_3000_he_sim_read_frame(&sims[0], &frame)) {
+			(void)tbcm_360_3000_he_dri_write_frame(&established,
+							       &frame);
+		}
+
+		(void)tbcm_360_3000_he_dri_update(&established, 1U);
+		pop_events(&established);
+
+		while (tbcm_360_3000_he_dri_read_frame(&established, &frame)) {
+			tbcm_360_3000_he_sim_write_frame(&sims[0], &frame);
+		}
+	}
+}
+
+/* Data frames, round robin over 0x353..0x355, 1ms apart */
+static void bench_rx_frame(uint32_t batches)
+{
+	struct tbcm_360_3000_he_dri_frame frames[3U];
+	double   ns = 0.0;
+	double   t0;
+	uint32_t b;
+	uint32_t i;
+
+	for (i = 0U; i < 3U; i++) {
+		frames[i].id  = 0x353U + i;
+		frames[i].len = 8U;
+		(void)memset(frames[i].data, 0U, 8U);
+		frames[i].data[0] = established._device_id;
+	}
+
+	for (b = 0U; b < batches; b++) {
+		dri = established;
+		t0  = now_ns();
+
+		for (i = 0U; i < BATCH; i++) {
+			(void)tbcm_360_3000_he_dri_write_frame(&dri,
+							       &frames[i % 3U]);
+			(void)tbcm_360_3000_he_dri_update(&dri, 1U);
+		}
+
+		ns += now_ns() - t0;
+
+		/* Make sure the hot path was measured, not a fault */
+		if (dri._state !=
+		    (uint8_t)TBCM_360_3000_HE_DRI_STATE_ESTABLISHED) {
+			fprintf(stderr, "rx_frame: link lost\n");
+			exit(1);
+		}
+	}
+
+	report("rx_frame", batches * BATCH, ns);
+}
+
+static void bench_idle(const char *name,
+		       const struct tbcm_360_3000_he_dri *snapshot,
+		       uint32_t batches)
+{
+	struct tbcm_360_3000_he_dri_frame frame;
+	double   ns = 0.0;
+	double   t0;
+	uint32_t b;
+	uint32_t i;
+
+	for (b = 0U; b < batches; b++) {
+		dri = *snapshot;
+		t0  = now_ns();
+
+		for (i = 0U; i < BATCH; i++) {
+			(void)tbcm_360_3000_he_dri_update(&dri, 1U);
+		}
+
+		ns += now_ns() - t0;
+
+		/* Keep writer from backing up (not timed) */
+		while (tbcm_360_3000_he_dri_read_frame(&dri, &frame)) {}
+
+		if (dri._state != snapshot->_state) {
+			fprintf(stderr, "%s: state changed\n", name);
+			exit(1);
+		}
+	}
+
+	report(name, batches * BATCH, ns);
+}
+
+static void bench_idle_states(uint32_t batches)
+{
+	static struct tbcm_360_3000_he_dri snapshot;
+	struct tbcm_360_3000_he_dri_frame frame;
+
+	tbcm_360_3000_he_dri_init(&snapshot);
+	bench_idle("idle_listen_devices", &snapshot, batches);
+
+	frame.id  = 0x350U;
+	frame.len = 6U;
+	(void)memcpy(frame.data, sims[0].cfg.serial_no, 6U);
+	(void)tbcm_360_3000_he_dri_write_frame(&snapshot, &frame);
+	(void)tbcm_360_3000_he_dri_update(&snapshot, 0U);
+	tbcm_360_3000_he_dri_accept_serial_no(&snapshot);
+	pop_events(&snapshot);
+	bench_idle("idle_query_device", &snapshot, batches);
+
+	bench_idle("idle_established", &established, batches);
+
+	/* Link loss with warm reconnect enabled */
+	snapshot = established;
+	tbcm_360_3000_he_dri_set_warm_reconnect(&snapshot, true);
+	(void)tbcm_360_3000_he_dri_update(&snapshot,
+					  TBCM_360_3000_HE_DRI_LINK_TIMEOUT_MS);
+	pop_events(&snapshot);
+	bench_idle("idle_reconnect", &snapshot, batches);
+}
+
+static void bench_getters(uint32_t calls)
+{
+	struct tbcm_360_3000_he_dri_telemetry telemetry;
+	char     buf[(6U * 2U) + 1U];
+	double   t0;
+	uint32_t i;
+
+	dri = established;
+
+	t0 = now_ns();
+	for (i = 0U; i < calls; i++) {
+		tbcm_360_3000_he_dri_get_telemetry(&dri, &telemetry);
+		sink = telemetry.seq;
+	}
+	report("get_telemetry", calls, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0U; i < calls; i++) {
+		sink = tbcm_360_3000_he_dri_get_out_voltage_dV(&dri);
+	}
+	report("get_out_voltage_dV", calls, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0U; i < calls; i++) {
+		sink = (uint32_t)tbcm_360_3000_he_dri_get_out_temp1(&dri);
+	}
+	report("get_out_temp1", calls, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0U; i < calls; i++) {
+		(void)tbcm_360_3000_he_dri_format_serial_no(&dri, buf);
+		sink = (uint32_t)buf[i % 12U];
+	}
+	report("format_serial_no", calls, now_ns() - t0);
+
+	t0 = now_ns();
+	for (i = 0U; i < calls; i++) {
+		sink = tbcm_360_3000_he_dri_next_deadline_ms(&dri);
+	}
+	report("next_deadline_ms", calls, now_ns() - t0);
+}
+
+/* Bus state at the start of the timed window */
+static struct tbcm_360_3000_he_dri_bus saved[SESSION_BUSES];
+
+/* Device to host frames of the timed window, replayed to the driver */
+static struct tbcm_360_3000_he_dri_frame *session_log;
+static uint32_t *session_log_n;
+static uint32_t  session_log_size;
+static uint32_t  session_log_used;
+
+/* Frames of one step, per bus */
+static struct tbcm_360_3000_he_dri_frame session_in[SESSION_BUSES]
+						   [FRAMES_PER_STEP];
+static struct tbcm_360_3000_he_dri_frame session_out[SESSION_BUSES]
+						    [FRAMES_PER_STEP];
+static uint32_t session_n_in[SESSION_BUSES];
+static uint32_t session_n_out[SESSION_BUSES];
+
+/* Device to host frames of one step (not timed) */
+static void session_devices(uint32_t b, struct tbcm_360_3000_he_sim *sim,
+			    uint32_t *rx)
+{
+	uint8_t  count = tbcm_360_3000_he_dri_bus_get_count(&buses[b]);
+	uint32_t n_in  = 0U;
+	uint8_t  j;
+
+	for (j = 0U; j < count; j++) {
+		tbcm_360_3000_he_sim_update(&sim[j], 1U);
+
+		while ((n_in < FRAMES_PER_STEP) &&
+		       tbcm_360_3000_he_sim_read_frame(&sim[j],
+						       &session_in[b][n_in])) {
+			n_in++;
+		}
+	}
+
+	session_n_in[b] = n_in;
+	*rx += n_in;
+}
+
+/* Everything driver (bus manager and instances) does in one step */
+static void session_driver(uint32_t b,
+			   struct tbcm_360_3000_he_dri_frame *in,
+			   uint32_t n_in)
+{
+	struct tbcm_360_3000_he_dri_bus *bus = &buses[b];
+	uint8_t  count = tbcm_360_3000_he_dri_bus_get_count(bus);
+	uint32_t n_out = 0U;
+	uint32_t i;
+	uint8_t  j;
+
+	for (i = 0U; i < n_in; i++) {
+		(void)tbcm_360_3000_he_dri_bus_write_frame(bus, &in[i]);
+	}
+
+	(void)tbcm_360_3000_he_dri_bus_update(bus, 1U);
+
+	for (j = 0U; j < count; j++) {
+		pop_events(tbcm_360_3000_he_dri_bus_get(bus, j));
+	}
+
+	while ((n_out < FRAMES_PER_STEP) &&
+	       tbcm_360_3000_he_dri_bus_read_frame(bus,
+						   &session_out[b][n_out])) {
+		n_out++;
+	}
+
+	session_n_out[b] = n_out;
+}
+
+/* Host to device frames of one step, broadcast, devices filter by
+ * themselves (not timed) */
+static void session_hosts(uint32_t b, struct tbcm_360_3000_he_sim *sim)
+{
+	uint8_t  count = tbcm_360_3000_he_dri_bus_get_count(&buses[b]);
+	uint32_t i;
+	uint8_t  j;
+
+	for (i = 0U; i < session_n_out[b]; i++) {
+		for (j = 0U; j < count; j++) {
+			tbcm_360_3000_he_sim_write_frame(&sim[j],
+							 &session_out[b][i]);
+		}
+	}
+}
+
+/* Appends frames of one bus step to the log (not timed) */
+static void session_record(uint32_t step, uint32_t b)
+{
+	struct tbcm_360_3000_he_dri_frame *log;
+	uint32_t size = session_log_size;
+	uint32_t i;
+
+	while ((session_log_used + session_n_in[b]) > size) {
+		size = (size > 0U) ? (size * 2U) : 4096U;
+	}
+
+	if (size != session_log_size) {
+		log = (struct tbcm_360_3000_he_dri_frame *)
+			realloc(session_log, sizeof(*log) * size);
+
+		if (log == NULL) {
+			fprintf(stderr, "session: out of memory\n");
+			exit(1);
+		}
+
+		session_log      = log;
+		session_log_size = size;
+	}
+
+	for (i = 0U; i < session_n_in[b]; i++) {
+		session_log[session_log_used + i] = session_in[b][i];
+	}
+
+	session_log_n[step] = session_n_in[b];
+	session_log_used   += session_n_in[b];
+}
+
+static void bench_session(uint32_t instances, uint32_t duration_ms)
+{
+	struct tbcm_360_3000_he_sim_config cfg;
+	uint32_t n_buses = (instances + TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES -
+			    1U) / TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES;
+	uint32_t up = 0U;
+	uint32_t rx = 0U;
+	uint32_t first;
+	uint32_t left;
+	uint32_t b;
+	uint32_t i;
+	uint32_t t;
+	double   ns;
+	double   t0;
+	struct tbcm_360_3000_he_dri_frame *in;
+	struct tbcm_360_3000_he_dri_bus *bus;
+
+	for (b = 0U, left = instances; b < n_buses; b++) {
+		bus   = &buses[b];
+		first = b * TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES;
+
+		tbcm_360_3000_he_dri_bus_init(&buses[b], (uint8_t)
+			((left > TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES) ?
+			 TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES : left));
+		left -= tbcm_360_3000_he_dri_bus_get_count(bus);
+
+		for (i = 0U; i < tbcm_360_3000_he_dri_bus_get_count(bus);
+		     i++) {
+			tbcm_360_3000_he_sim_default_config(&cfg, first + i);
+			tbcm_360_3000_he_sim_init(&sims[first + i], &cfg);
+			(void)establish(tbcm_360_3000_he_dri_bus_get(bus,
+							(uint8_t)i),
+					&sims[first + i]);
+		}
+	}
+
+	session_log_n = (uint32_t *)malloc(sizeof(*session_log_n) *
+					  duration_ms * n_buses);
+	session_log_used = 0U;
+
+	if (session_log_n == NULL) {
+		fprintf(stderr, "session: out of memory\n");
+		exit(1);
+	}
+
+	/* Devices and driver run together, device frames of the window are
+	 * logged, so only the driver side can be replayed and timed */
+	for (t = 0U; t < (SESSION_WARM_MS + duration_ms); t++) {
+		if (t == SESSION_WARM_MS) {
+			for (b = 0U; b < n_buses; b++) {
+				saved[b] = buses[b];
+			}
+
+			rx = 0U;
+		}
+
+		for (b = 0U; b < n_buses; b++) {
+			session_devices(b,
+			      &sims[b * TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES],
+			      &rx);
+
+			if (t >= SESSION_WARM_MS) {
+				session_record(((t - SESSION_WARM_MS) *
+						n_buses) + b, b);
+			}
+
+			session_driver(b, session_in[b], session_n_in[b]);
+			session_hosts(b, &sims[b *
+				       TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES]);
+		}
+	}
+
+	for (b = 0U; b < n_buses; b++) {
+		buses[b] = saved[b];
+	}
+
+	/* Same inputs from the same state give the same steps, the whole
+	 * window is timed once */
+	t0 = now_ns();
+
+	for (t = 0U, in = session_log; t < duration_ms; t++) {
+		for (b = 0U; b < n_buses; b++) {
+			session_driver(b, in, session_log_n[(t * n_buses) + b]);
+			in += session_log_n[(t * n_buses) + b];
+		}
+	}
+
+	ns = now_ns() - t0 - timer_ns;
+
+	/* Timer noise can't make driver faster than free */
+	if (ns < 0.0) {
+		ns = 0.0;
+	}
+
+	free(session_log_n);
+	session_log_n = NULL;
+
+	for (b = 0U; b < n_buses; b++) {
+		for (i = 0U; i < tbcm_360_3000_he_dri_bus_get_count(&buses[b]);
+		     i++) {
+			if (tbcm_360_3000_he_dri_bus_get(&buses[b], (uint8_t)i)
+			    ->_state ==
+			    (uint8_t)TBCM_360_3000_HE_DRI_STATE_ESTABLISHED) {
+				up++;
+			}
+		}
+	}
+
+	/* Instance tick - everything driver does for one instance in 1ms
+	 * (routing, update, events, TX). cpu_pct - share of one core needed
+	 * to keep up in real time */
+	printf("bench=session instances=%lu buses=%lu established=%lu "
+	       "sim_ms=%lu rx_frames=%lu ns_per_instance_tick=%.1f "
+	       "cpu_pct=%.3f\n",
+	       (unsigned long)instances, (unsigned long)n_buses,
+	       (unsigned long)up, (unsigned long)duration_ms,
+	       (unsigned long)rx,
+	       ns / ((double)instances * (double)duration_ms),
+	       ns / ((double)duration_ms * 1e4));
+
+	if (up != instances) {
+		fprintf(stderr, "session: %lu of %lu established\n",
+			(unsigned long)up, (unsigned long)instances);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t instances[] = {1U, 16U, 256U, 4096U};
+	uint32_t scale = 1U;
+	uint32_t i;
+
+	if (argc > 1) {
+		scale = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	calibrate();
+
+	printf("bench=config RX_QUEUE_SIZE=%u EVENT_QUEUE_SIZE=%u "
+	       "BUS_MAX_INSTANCES=%u scale=%lu timer_ns=%.1f\n",
+	       (unsigned)TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE,
+	       (unsigned)TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE,
+	       (unsigned)TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES,
+	       (unsigned long)scale, timer_ns);
+
+	prepare_established();
+
+	bench_rx_frame(10000U * scale);
+	bench_idle_states(10000U * scale);
+	bench_getters(1000000U * scale);
+
+	for (i = 0U; i < (sizeof(instances) / sizeof(instances[0])); i++) {
+		bench_session(instances[i], SESSION_MS * scale);
+	}
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Driver benchmark (see bench.c). Results go to stdout as key=value lines.
+#
+# Usage: bench.sh [baseline] [scale]
+# With baseline (saved output of earlier run), every ns_per_* figure is
+# compared against it and the script fails if any got slower by more than
+# BENCH_TOLERANCE_PCT percent (default 30) and BENCH_TOLERANCE_NS ns
+# (default 5) at once, host timing of few ns paths is noisy. A ns_per_*
+# figure that is not positive (in run or baseline) means broken timing
+# and fails the script as well
+
+# Fail on errors
+set -e
+
+cd "$(dirname "$0")"
+
+BASELINE="$1"
+SCALE="${2:-1}"
+TOLERANCE="${BENCH_TOLERANCE_PCT:-30}"
+TOLERANCE_NS="${BENCH_TOLERANCE_NS:-5}"
+
+gcc bench.c -Wall -Wextra -std=c89 -pedantic -O2 -o bench.out
+./bench.out "$SCALE" | tee bench.last
+rm -f bench.out
+
+# Key is bench name (plus instance count for sessions)
+awk -v tolerance="$TOLERANCE" -v tolerance_ns="$TOLERANCE_NS" '
+function parse(line, out,    n, i, kv, f) {
+	n = split(line, f, " ")
+	for (i = 1; i <= n; i++) {
+		split(f[i], kv, "=")
+		out[kv[1]] = kv[2]
+	}
+}
+{
+	delete r
+	parse($0, r)
+	key = r["bench"] (("instances" in r) ? ":" r["instances"] : "")
+
+	for (k in r) {
+		if (k !~ /^ns_per_/) {
+			continue
+		}
+
+		if (r[k] <= 0) {
+			printf("invalid=%s %s value=%s file=%s\n", key, k,
+			       r[k], FILENAME)
+			failed = 1
+		} else if ((FNR == NR) && (ARGC > 2)) {
+			base[key, k] = r[k]
+		} else if ((key, k) in base) {
+			pct  = (r[k] / base[key, k] - 1) * 100
+			slow = (pct > tolerance) &&
+			       ((r[k] - base[key, k]) > tolerance_ns)
+			status = slow ? "REGRESSION" : "ok"
+			printf("compare=%s %s base=%s now=%s " \
+			       "change_pct=%.1f %s\n", key, k,
+			       base[key, k], r[k], pct, status)
+
+			if (slow) {
+				failed = 1
+			}
+		}
+	}
+}
+END { exit failed }' ${BASELINE:+"$BASELINE"} bench.last || FAILED=1
+
+rm -f bench.last
+
+exit ${FAILED:-0}
@@ -0,0 +1,54 @@
+/* Host side memory footprint report.
+ * Prints RAM cost of the driver for the configuration it was built with
+ * (see footprint.sh, which builds it for several configurations) */
+#include <stdio.h>
+
+#include "../tbcm_360_3000_he_dri.h"
+
+#define FOOTPRINT_ROW(name, size)					      \
+	printf("%-34s %8lu\n", (name), (unsigned long)(size))
+
+int main(void)
+{
+	printf("config: RX_QUEUE_SIZE=%u EVENT_QUEUE_SIZE=%u TRACE_SIZE=%u "
+	       "BUS_MAX_INSTANCES=%u pointer=%lu\n",
+	       (unsigned)TBCM_360_3000_HE_DRI_RX_QUEUE_SIZE,
+	       (unsigned)TBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE,
+	       (unsigned)TBCM_360_3000_HE_DRI_TRACE_SIZE,
+	       (unsigned)TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES,
+	       (unsigned long)sizeof(void *));
+
+	FOOTPRINT_ROW("struct tbcm_360_3000_he_dri",
+		      sizeof(struct tbcm_360_3000_he_dri));
+	FOOTPRINT_ROW("  writer",
+		      sizeof(struct tbcm_360_3000_he_dri_writer));
+	FOOTPRINT_ROW("  reader",
+		      sizeof(struct tbcm_360_3000_he_dri_reader));
+	FOOTPRINT_ROW("    rx queue",
+		      sizeof(struct tbcm_360_3000_he_dri_rx_queue));
+	FOOTPRINT_ROW("    telemetry (x2)",
+		      2U * sizeof(struct tbcm_360_3000_he_dri_telemetry));
+	FOOTPRINT_ROW("  event queue",
+		      sizeof(struct tbcm_360_3000_he_dri_event_queue));
+#ifndef TBCM_360_3000_HE_DRI_NO_COUNTERS
+	FOOTPRINT_ROW("  counters",
+		      sizeof(struct tbcm_360_3000_he_dri_counters));
+#endif
+#if (TBCM_360_3000_HE_DRI_TRACE_SIZE > 0U)
+	FOOTPRINT_ROW("  trace",
+		      sizeof(struct tbcm_360_3000_he_dri_trace));
+#endif
+	FOOTPRINT_ROW("  budget", TBCM_360_3000_HE_DRI_SIZE_BUDGET);
+
+	FOOTPRINT_ROW("struct tbcm_360_3000_he_dri_bus",
+		      sizeof(struct tbcm_360_3000_he_dri_bus));
+	FOOTPRINT_ROW("  per instance (with routing)",
+		      sizeof(struct tbcm_360_3000_he_dri_bus) /
+		      TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES);
+	FOOTPRINT_ROW("  budget", TBCM_360_3000_HE_DRI_BUS_SIZE_BUDGET);
+
+	return ((sizeof(struct tbcm_360_3000_he_dri) <=
+		 TBCM_360_3000_HE_DRI_SIZE_BUDGET) &&
+		(sizeof(struct tbcm_360_3000_he_dri_bus) <=
+		 TBCM_360_3000_HE_DRI_BUS_SIZE_BUDGET)) ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Memory footprint report for several driver configurations.
+# Extra compiler flags can be passed as arguments (e.g. -m32)
+
+# Fail on errors
+set -e
+
+cd "$(dirname "$0")"
+
+CONFIGS=(
+	""
+	"-DTBCM_360_3000_HE_DRI_RX_QUEUE_SIZE=4U"
+	"-DTBCM_360_3000_HE_DRI_RX_QUEUE_SIZE=16U"
+	"-DTBCM_360_3000_HE_DRI_EVENT_QUEUE_SIZE=1U"
+	"-DTBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES=8U"
+	"-DTBCM_360_3000_HE_DRI_NO_COUNTERS"
+	"-DTBCM_360_3000_HE_DRI_TRACE_SIZE=32U"
+)
+
+for config in "${CONFIGS[@]}"; do
+	gcc footprint.c -Wall -Wextra -std=c89 -pedantic $config "$@" \
+	    -o footprint.out
+	./footprint.out
+	echo
+done
+
+rm -f footprint.out
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Load tests of the driver against simulated devices (no CAN needed).
+# Extra compiler flags can be passed as arguments (e.g. -fsanitize=address)
+
+# Fail on errors
+set -e
+
+cd "$(dirname "$0")"
+
+# Host TX is paced to 4 frames per ms (roughly what 500 kbit/s CAN carries)
+gcc sim_loopback.c -Wall -Wextra -Werror -std=c89 -pedantic -O2 \
+    -DTBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES=255U \
+    -DTBCM_360_3000_HE_DRI_BUS_TX_FRAMES_PER_MS=4U \
+    -DTBCM_360_3000_HE_DRI_TRACE_SIZE=64U "$@" -o sim_loopback.out
+gcc ../trace_export.c -Wall -Wextra -Werror -std=c89 -pedantic \
+    -o trace_export.out
+
+# devices seconds loss_pct latency_ms jitter_ms warm_reconnect
+SCENARIOS=(
+	"1 10"
+	"64 30"
+	"255 60"
+	"64 30 5 10 20"
+	"255 60 2 5 10 1"
+)
+
+for scenario in "${SCENARIOS[@]}"; do
+	./sim_loopback.out $scenario
+done
+
+# Discovery and reconnects of a few instances as Chrome/Perfetto trace,
+# written out of the tree
+TRACE_DIR="${TMPDIR:-/tmp}"
+./sim_loopback.out 4 20 5 10 20 1 "$TRACE_DIR/sim_trace_"
+./trace_export.out "$TRACE_DIR"/sim_trace_*.bin > "$TRACE_DIR/sim_trace.json"
+echo "$TRACE_DIR/sim_trace.json: $(wc -c < "$TRACE_DIR/sim_trace.json") bytes"
+
+rm -f sim_loopback.out trace_export.out "$TRACE_DIR"/sim_trace_*.bin
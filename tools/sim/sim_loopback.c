@@ -0,0 +1,396 @@
+/* In-process load test: bus manager with N driver instances against N
+ * simulated devices (tbcm_360_3000_he_sim.h) on a virtual CAN bus.
+ *
+ * Runs in simulated time with 1ms step, so it needs no CAN hardware and
+ * is deterministic for given arguments. Every instance claims a device
+ * nobody else has claimed (like socketcan_demo), and on ESTABLISHED sets
+ * its own voltage setpoint. At the end every instance must be established
+ * and both the device output and the telemetry reported by the driver
+ * must match the setpoint.
+ *
+ * With link impairments instances may drop out and come back, then only
+ * the ones that are up (and settled) are checked, and availability (share
+ * of time instances were established) tells how bad it was.
+ *
+ * With trace_prefix every instance dumps its trace ring into
+ * <trace_prefix><index>.bin (driver must be built with
+ * TBCM_360_3000_HE_DRI_TRACE_SIZE > 0), see tools/trace_export.
+ *
+ * Usage: sim_loopback [devices] [seconds] [loss_pct] [latency_ms]
+ *		       [jitter_ms] [warm_reconnect] [trace_prefix]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tbcm_360_3000_he_sim.h"
+
+#define MAX_DEVICES     TBCM_360_3000_HE_DRI_BUS_MAX_INSTANCES
+#define STEP_MS         1U
+#define SET_CURRENT_DA  50U
+#define SETTLE_MS       5000U /* Slew to highest setpoint plus telemetry */
+
+static struct tbcm_360_3000_he_dri_bus bus;
+static struct tbcm_360_3000_he_sim     sim[MAX_DEVICES];
+
+/* Per instance application state */
+static uint8_t  claimed[MAX_DEVICES][6U]; /* Serial no (zeros - none) */
+static bool     bound[MAX_DEVICES];       /* Device id accepted */
+static bool     established[MAX_DEVICES];
+static uint32_t established_ms[MAX_DEVICES]; /* Since when */
+static uint16_t setpoint_dV[MAX_DEVICES];
+
+static uint32_t now_ms;
+
+/* Totals */
+static uint64_t up_ms; /* Sum of time instances were established */
+static uint32_t faults;
+static uint32_t id_rejects;
+static uint32_t last_established_ms;
+static uint32_t tx_max_per_ms; /* Highest number of host frames in a step */
+
+static FILE *trace[MAX_DEVICES]; /* Trace dump files (NULL - none) */
+
+static bool is_claimed(const uint8_t *serial_no, uint8_t count)
+{
+	uint8_t i;
+	bool    found = false;
+
+	for (i = 0U; i < count; i++) {
+		if (memcmp(claimed[i], serial_no, 6U) == 0) {
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/* Device id is taken by another instance already */
+static bool is_owned(uint8_t index, uint8_t device_id, uint8_t count)
+{
+	struct tbcm_360_3000_he_dri *dri;
+	uint8_t i;
+	bool    found = false;
+
+	for (i = 0U; i < count; i++) {
+		dri = tbcm_360_3000_he_dri_bus_get(&bus, i);
+
+		if ((i != index) && bound[i] &&
+		    (tbcm_360_3000_he_dri_get_device_id(dri) == device_id)) {
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+static void handle_event(uint8_t index, uint8_t count,
+			 struct tbcm_360_3000_he_dri_event_record *record)
+{
+	struct tbcm_360_3000_he_dri *dri =
+				 tbcm_360_3000_he_dri_bus_get(&bus, index);
+	const uint8_t *serial_no = tbcm_360_3000_he_dri_get_serial_no_raw(dri);
+
+	switch (record->event) {
+	case TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO:
+		if (is_claimed(serial_no, count)) {
+			tbcm_360_3000_he_dri_reject_serial_no(dri);
+		} else {
+			(void)memcpy(claimed[index], serial_no, 6U);
+			tbcm_360_3000_he_dri_accept_serial_no(dri);
+		}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID:
+		if (is_owned(index, tbcm_360_3000_he_dri_get_device_id(dri),
+			     count)) {
+			id_rejects++;
+			tbcm_360_3000_he_dri_reject_device_id(dri);
+		} else {
+			bound[index] = true;
+			tbcm_360_3000_he_dri_accept_device_id(dri);
+		}
+
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED:
+		established[index]    = true;
+		established_ms[index] = now_ms;
+		last_established_ms   = now_ms;
+
+		tbcm_360_3000_he_dri_set_voltage_dV(dri, setpoint_dV[index]);
+		tbcm_360_3000_he_dri_set_current_dA(dri, SET_CURRENT_DA);
+		tbcm_360_3000_he_dri_set_charging_mode(dri, 1U);
+		break;
+
+	case TBCM_360_3000_HE_DRI_EVENT_FAULT:
+		faults++;
+		bound[index]       = false;
+		established[index] = false;
+		(void)memset(claimed[index], 0, 6U);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* Move trace records of instance to its dump file */
+static void dump_trace(uint8_t index)
+{
+	uint8_t  buf[64U * TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE];
+	uint16_t n;
+
+	if (trace[index] != NULL) {
+		do {
+			n = tbcm_360_3000_he_dri_trace_dump(
+				  tbcm_360_3000_he_dri_bus_get(&bus, index),
+				  buf, sizeof(buf));
+			(void)fwrite(buf, 1U, n, trace[index]);
+		} while (n > 0U);
+	}
+}
+
+/* One step of simulated time */
+static void step(uint8_t count)
+{
+	struct tbcm_360_3000_he_dri_event_record record;
+	struct tbcm_360_3000_he_dri_frame frame;
+	struct tbcm_360_3000_he_dri *dri;
+	uint32_t n = 0U;
+	uint8_t  i;
+	uint8_t  j;
+
+	/* Devices to host */
+	for (i = 0U; i < count; i++) {
+		tbcm_360_3000_he_sim_update(&sim[i], STEP_MS);
+
+		while (tbcm_360_3000_he_sim_read_frame(&sim[i], &frame)) {
+			(void)tbcm_360_3000_he_dri_bus_write_frame(&bus,
+								   &frame);
+		}
+	}
+
+	/* Drivers, bus updates only those that are due or got frames */
+	(void)tbcm_360_3000_he_dri_bus_update(&bus, STEP_MS);
+
+	for (i = 0U; i < count; i++) {
+		dri = tbcm_360_3000_he_dri_bus_get(&bus, i);
+
+		if (established[i]) {
+			up_ms += STEP_MS;
+		}
+
+		while (tbcm_360_3000_he_dri_pop_event(dri, &record)) {
+			handle_event(i, count, &record);
+			tbcm_360_3000_he_dri_bus_wake(&bus, i);
+		}
+
+		dump_trace(i);
+	}
+
+	/* Host to devices (broadcast, devices filter by themselves) */
+	while (tbcm_360_3000_he_dri_bus_read_frame(&bus, &frame)) {
+		for (j = 0U; j < count; j++) {
+			tbcm_360_3000_he_sim_write_frame(&sim[j], &frame);
+		}
+
+		n++;
+	}
+
+	if (n > tx_max_per_ms) {
+		tx_max_per_ms = n;
+	}
+}
+
+/* Simulated device with given device id (NULL if none) */
+static struct tbcm_360_3000_he_sim *find_sim(uint8_t device_id, uint8_t count)
+{
+	struct tbcm_360_3000_he_sim *found = NULL;
+	uint8_t i;
+
+	for (i = 0U; i < count; i++) {
+		if (sim[i].cfg.device_id == device_id) {
+			found = &sim[i];
+		}
+	}
+
+	return found;
+}
+
+int main(int argc, char **argv)
+{
+	struct tbcm_360_3000_he_sim_config cfg;
+	struct tbcm_360_3000_he_sim *dev;
+	struct tbcm_360_3000_he_dri *dri;
+	uint32_t devices    = 64U;
+	uint32_t seconds    = 30U;
+	uint32_t loss_pct   = 0U;
+	uint32_t latency_ms = 0U;
+	uint32_t jitter_ms  = 0U;
+	uint32_t warm       = 0U;
+	uint32_t n_established = 0U;
+	uint32_t n_settled     = 0U;
+	uint32_t off_setpoint  = 0U; /* Device output is not at setpoint */
+	uint32_t off_telemetry = 0U; /* Driver doesn't see device output */
+	uint32_t mismatched    = 0U; /* Serial no and device id from two
+					devices (see bus manager) */
+	uint32_t sim_rx_lost   = 0U;
+	uint32_t sim_tx_lost   = 0U;
+	uint32_t sim_overflows = 0U;
+	uint32_t rx_overflows  = 0U;
+	const char *trace_prefix = NULL;
+	char     path[256];
+	uint8_t  count;
+	uint8_t  i;
+	bool     ok;
+
+	if (argc > 1) {
+		devices = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	if (argc > 2) {
+		seconds = (uint32_t)strtoul(argv[2], NULL, 0);
+	}
+
+	if (argc > 3) {
+		loss_pct = (uint32_t)strtoul(argv[3], NULL, 0);
+	}
+
+	if (argc > 4) {
+		latency_ms = (uint32_t)strtoul(argv[4], NULL, 0);
+	}
+
+	if (argc > 5) {
+		jitter_ms = (uint32_t)strtoul(argv[5], NULL, 0);
+	}
+
+	if (argc > 6) {
+		warm = (uint32_t)strtoul(argv[6], NULL, 0);
+	}
+
+	if (argc > 7) {
+		trace_prefix = argv[7];
+	}
+
+	if ((trace_prefix != NULL) && (TBCM_360_3000_HE_DRI_TRACE_SIZE == 0U)) {
+		fprintf(stderr, "trace is disabled, build with "
+			"-DTBCM_360_3000_HE_DRI_TRACE_SIZE=64U\n");
+		return 2;
+	}
+
+	if ((trace_prefix != NULL) &&
+	    (strlen(trace_prefix) > (sizeof(path) - 16U))) {
+		fprintf(stderr, "trace_prefix is too long\n");
+		return 2;
+	}
+
+	/* Device id is 8 bit, so there can't be more devices on one bus */
+	if ((devices < 1U) || (devices > MAX_DEVICES)) {
+		fprintf(stderr, "devices must be in range 1..%u\n",
+			(unsigned)MAX_DEVICES);
+		return 2;
+	}
+
+	count = (uint8_t)devices;
+	tbcm_360_3000_he_dri_bus_init(&bus, count);
+
+	for (i = 0U; i < count; i++) {
+		tbcm_360_3000_he_sim_default_config(&cfg, i);
+		cfg.loss_pct   = (uint8_t)loss_pct;
+		cfg.latency_ms = (uint16_t)latency_ms;
+		cfg.jitter_ms  = (uint16_t)jitter_ms;
+		tbcm_360_3000_he_sim_init(&sim[i], &cfg);
+
+		tbcm_360_3000_he_dri_set_warm_reconnect(
+			tbcm_360_3000_he_dri_bus_get(&bus, i), warm != 0U);
+
+		/* 100.0V .. 354.0V, different for every instance */
+		setpoint_dV[i] = (uint16_t)(1000U + (i * 10U));
+
+		if (trace_prefix != NULL) {
+			(void)sprintf(path, "%s%u.bin", trace_prefix,
+				      (unsigned)i);
+			trace[i] = fopen(path, "wb");
+
+			if (trace[i] == NULL) {
+				perror(path);
+				return 1;
+			}
+		}
+	}
+
+	for (now_ms = 0U; now_ms < (seconds * 1000U); now_ms += STEP_MS) {
+		step(count);
+	}
+
+	for (i = 0U; i < count; i++) {
+		dri = tbcm_360_3000_he_dri_bus_get(&bus, i);
+		dev = find_sim(tbcm_360_3000_he_dri_get_device_id(dri), count);
+
+		rx_overflows += tbcm_360_3000_he_dri_get_rx_overflows(dri);
+
+		if (trace[i] != NULL) {
+			(void)fclose(trace[i]);
+		}
+
+		sim_rx_lost  += sim[i].rx_lost;
+		sim_tx_lost  += sim[i].tx_lost;
+		sim_overflows += sim[i].tx_overflows;
+
+		if (!established[i] || (dev == NULL)) {
+			continue;
+		}
+
+		n_established++;
+
+		/* Bound to device id of another serial no, that device is not
+		 * queried and drops its setpoints on query timeout */
+		if (memcmp(dev->cfg.serial_no, claimed[i], 6U) != 0) {
+			mismatched++;
+		}
+
+		/* Output is still slewing or telemetry is not complete yet */
+		if ((now_ms - established_ms[i]) < SETTLE_MS) {
+			continue;
+		}
+
+		n_settled++;
+
+		if (tbcm_360_3000_he_sim_get_out_voltage_dV(dev) !=
+		    setpoint_dV[i]) {
+			off_setpoint++;
+		}
+
+		if (tbcm_360_3000_he_dri_get_out_voltage_dV(dri) !=
+		    tbcm_360_3000_he_sim_get_out_voltage_dV(dev)) {
+			off_telemetry++;
+		}
+	}
+
+	/* Lossy link may legitimately be down at the end of run, but device
+	 * that is up must never be driven off its setpoint */
+	ok = ((n_established == count) || (loss_pct > 0U)) &&
+	     (off_setpoint == 0U) && (off_telemetry == 0U);
+
+	printf("devices=%u seconds=%u loss_pct=%u latency_ms=%u jitter_ms=%u "
+	       "warm=%u established=%u settled=%u availability=%.4f "
+	       "last_established_ms=%lu faults=%lu id_rejects=%lu "
+	       "mismatched=%lu off_setpoint=%lu off_telemetry=%lu "
+	       "rx_overflows=%lu bus_dropped=%lu sim_rx_lost=%lu "
+	       "sim_tx_lost=%lu sim_overflows=%lu tx_max_per_ms=%lu "
+	       "result=%s\n",
+	       (unsigned)devices, (unsigned)seconds, (unsigned)loss_pct,
+	       (unsigned)latency_ms, (unsigned)jitter_ms, (unsigned)warm,
+	       (unsigned)n_established, (unsigned)n_settled,
+	       (double)up_ms / ((double)count * (double)now_ms),
+	       (unsigned long)last_established_ms,
+	       (unsigned long)faults, (unsigned long)id_rejects,
+	       (unsigned long)mismatched, (unsigned long)off_setpoint,
+	       (unsigned long)off_telemetry, (unsigned long)rx_overflows,
+	       (unsigned long)bus.dropped, (unsigned long)sim_rx_lost,
+	       (unsigned long)sim_tx_lost, (unsigned long)sim_overflows,
+	       (unsigned long)tx_max_per_ms, ok ? "PASS" : "FAIL");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,434 @@
+/** Software model of TBCM 360/3000 HE PSU (device side of the protocol).
+ *
+ * Behaves the way tbcm_360_3000_he_dri expects the real device to:
+ *	- broadcasts 0x350 (serial no) until it's queried by 0x351
+ *	- while queried (0x351 with its serial no), emits 0x353, 0x354, 0x355
+ *	  with its device id, each at its own period
+ *	- applies 0x352 setpoints addressed to its device id, output voltage
+ *	  slews towards setpoint, output current is set by resistive load and
+ *	  limited by current setpoint
+ *	- stops talking (and broadcasts serial no again) if it's not queried
+ *	  for too long
+ *
+ * Link impairments: frame loss (both directions), latency and jitter
+ * (device to host direction), all deterministic for a given seed.
+ *
+ * Frame I/O mirrors the driver: frames from host go to write_frame, frames
+ * from device come out of read_frame, so it plugs straight into driver,
+ * bus manager or a CAN socket.
+ *
+ * Units and layout of frames are the ones assumed by the driver.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../tbcm_360_3000_he_dri.h"
+
+/* Frames that can be in flight (delayed by latency) at once */
+#ifndef TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE
+#define TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE 16U
+#endif
+
+/******************************************************************************
+ * CLASS
+ *****************************************************************************/
+struct tbcm_360_3000_he_sim_config {
+	uint8_t serial_no[6U]; /* Raw, 2 decimal digits per byte */
+	uint8_t device_id;
+
+	/* Periods */
+	uint16_t serial_no_period_ms; /* 0x350 broadcast */
+	uint16_t data_period_ms[3U];  /* 0x353, 0x354, 0x355 */
+	uint16_t query_timeout_ms;    /* Stop talking without 0x351 */
+
+	/* Output model */
+	uint16_t slew_dV_per_s;  /* Output voltage slew rate */
+	uint16_t load_ohm;       /* Resistive load on output (0 - open) */
+	uint16_t max_current_dA; /* Hardware current limit */
+	uint8_t  in_voltage_V;
+
+	/* Link impairments */
+	uint8_t  loss_pct;   /* Frame loss probability, both directions */
+	uint16_t latency_ms; /* Device to host delay */
+	uint16_t jitter_ms;  /* Extra random delay 0..jitter_ms */
+	uint32_t seed;       /* PRNG seed (non zero) */
+};
+
+/* Frame waiting for its delivery time */
+struct tbcm_360_3000_he_sim_pending {
+	uint32_t due_ms;
+	struct tbcm_360_3000_he_dri_frame frame;
+};
+
+struct tbcm_360_3000_he_sim {
+	struct tbcm_360_3000_he_sim_config cfg;
+
+	uint32_t time_ms;
+	uint32_t rng;
+
+	/* Host has queried us recently (we are talking) */
+	bool     queried;
+	uint32_t query_timer_ms;
+
+	uint32_t serial_no_timer_ms;
+	uint32_t data_timer_ms[3U];
+
+	/* Setpoints (0x352) */
+	bool     enabled;
+	uint16_t set_voltage_dV;
+	uint16_t set_current_dA;
+
+	/* Output state */
+	uint32_t out_voltage_mV; /* Finer than dV, so slow slew works */
+	uint16_t out_current_dA;
+
+	/* Device to host frames (FIFO, ordered by due time) */
+	struct tbcm_360_3000_he_sim_pending
+				  tx[TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE];
+	uint8_t  tx_head;
+	uint8_t  tx_count;
+
+	/* Statistics */
+	uint32_t rx_frames;  /* Frames taken from host */
+	uint32_t rx_lost;    /* Host frames lost by impairment */
+	uint32_t tx_frames;  /* Frames delivered to host */
+	uint32_t tx_lost;    /* Device frames lost by impairment */
+	uint32_t tx_overflows;
+	uint32_t settings;   /* 0x352 applied */
+};
+
+/******************************************************************************
+ * PRIVATE
+ *****************************************************************************/
+/* xorshift32 */
+uint32_t _tbcm_360_3000_he_sim_random(struct tbcm_360_3000_he_sim *self)
+{
+	uint32_t x = self->rng;
+
+	x ^= x << 13U;
+	x ^= x >> 17U;
+	x ^= x << 5U;
+	self->rng = x;
+
+	return x;
+}
+
+bool _tbcm_360_3000_he_sim_lost(struct tbcm_360_3000_he_sim *self)
+{
+	return (self->cfg.loss_pct > 0U) &&
+	       ((_tbcm_360_3000_he_sim_random(self) % 100U) <
+		self->cfg.loss_pct);
+}
+
+/* Queue frame to host, applying impairments */
+void _tbcm_360_3000_he_sim_send(struct tbcm_360_3000_he_sim *self,
+				uint32_t id, uint8_t len, const uint8_t *data)
+{
+	struct tbcm_360_3000_he_sim_pending *p;
+	uint32_t due = self->time_ms + self->cfg.latency_ms;
+	uint32_t last;
+	uint8_t  tail;
+
+	if (self->cfg.jitter_ms > 0U) {
+		due += _tbcm_360_3000_he_sim_random(self) %
+		       ((uint32_t)self->cfg.jitter_ms + 1U);
+	}
+
+	if (_tbcm_360_3000_he_sim_lost(self)) {
+		self->tx_lost++;
+	} else if (self->tx_count >= TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE) {
+		self->tx_overflows++;
+	} else {
+		/* Single node never reorders its own frames */
+		if (self->tx_count > 0U) {
+			last = self->tx[(self->tx_head + self->tx_count - 1U) %
+				  TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE].due_ms;
+
+			if (due < last) {
+				due = last;
+			}
+		}
+
+		tail = (uint8_t)((self->tx_head + self->tx_count) %
+				 TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE);
+		p = &self->tx[tail];
+
+		p->due_ms    = due;
+		p->frame.id  = id;
+		p->frame.len = len;
+		(void)memset(p->frame.data, 0U, 8U);
+		(void)memcpy(p->frame.data, data, len);
+
+		self->tx_count++;
+	}
+}
+
+void _tbcm_360_3000_he_sim_send_data(struct tbcm_360_3000_he_sim *self,
+				     uint8_t index)
+{
+	uint8_t  data[8U];
+	uint16_t out_dV = (uint16_t)(self->out_voltage_mV / 100U);
+	int32_t  temp;
+
+	(void)memset(data, 0U, 8U);
+	data[0] = self->cfg.device_id;
+
+	switch (index) {
+	case 0U:
+		data[4] = (uint8_t)(self->out_current_dA >> 8U);
+		data[5] = (uint8_t)self->out_current_dA;
+		data[6] = (uint8_t)(out_dV >> 8U);
+		data[7] = (uint8_t)out_dV;
+		break;
+
+	case 1U:
+		/* Heats up with output current */
+		temp    = 25 + (int32_t)(self->out_current_dA / 5U);
+		data[1] = (uint8_t)temp;
+		data[2] = (uint8_t)(temp + 3);
+		data[4] = self->cfg.in_voltage_V;
+		break;
+
+	default:
+		/* Status, all zeros (no errors) */
+		break;
+	}
+
+	_tbcm_360_3000_he_sim_send(self, 0x353U + index, 8U, data);
+}
+
+/* Move output towards setpoints */
+void _tbcm_360_3000_he_sim_output(struct tbcm_360_3000_he_sim *self,
+				  uint32_t delta_time_ms)
+{
+	uint32_t target_mV = self->enabled ?
+			     ((uint32_t)self->set_voltage_dV * 100U) : 0U;
+	uint32_t step_mV   = (uint32_t)self->cfg.slew_dV_per_s *
+			     delta_time_ms / 10U;
+	uint32_t limit_dA  = self->cfg.max_current_dA;
+	uint32_t current_dA;
+
+	if (self->out_voltage_mV < target_mV) {
+		self->out_voltage_mV = ((target_mV - self->out_voltage_mV) >
+					step_mV) ?
+				       (self->out_voltage_mV + step_mV) :
+				       target_mV;
+	} else {
+		self->out_voltage_mV = ((self->out_voltage_mV - target_mV) >
+					step_mV) ?
+				       (self->out_voltage_mV - step_mV) :
+				       target_mV;
+	}
+
+	/* Zero current setpoint has no effect (see driver) */
+	if ((self->set_current_dA > 0U) && (self->set_current_dA < limit_dA)) {
+		limit_dA = self->set_current_dA;
+	}
+
+	current_dA = 0U;
+
+	if (self->cfg.load_ohm > 0U) {
+		/* I = U / R, mV / ohm = mA, mA / 100 = dA */
+		current_dA = self->out_voltage_mV / self->cfg.load_ohm / 100U;
+	}
+
+	if (current_dA > limit_dA) {
+		/* Constant current mode, voltage sags to keep limit */
+		current_dA = limit_dA;
+		self->out_voltage_mV = limit_dA * 100U * self->cfg.load_ohm;
+	}
+
+	self->out_current_dA = (uint16_t)current_dA;
+}
+
+/******************************************************************************
+ * PUBLIC
+ *****************************************************************************/
+/* Reasonable defaults for n-th simulated device (serial no and device id
+ * are derived from n, device id is never zero) */
+void tbcm_360_3000_he_sim_default_config(
+				     struct tbcm_360_3000_he_sim_config *cfg,
+				     uint32_t n)
+{
+	uint32_t serial = 100000U + n;
+	uint8_t  i;
+
+	/* 12 decimal digits, 2 per byte */
+	for (i = 0U; i < 6U; i++) {
+		cfg->serial_no[5U - i] =
+				(uint8_t)(((serial / 10U % 10U) << 4U) |
+					  (serial % 10U));
+		serial /= 100U;
+	}
+
+	cfg->device_id = (uint8_t)((n % 255U) + 1U);
+
+	cfg->serial_no_period_ms = 1000U;
+	cfg->data_period_ms[0]   = 100U;
+	cfg->data_period_ms[1]   = 200U;
+	cfg->data_period_ms[2]   = 1000U;
+	cfg->query_timeout_ms    = 5000U;
+
+	cfg->slew_dV_per_s  = 1000U; /* 100V/s */
+	cfg->load_ohm       = 100U;
+	cfg->max_current_dA = 100U;
+	cfg->in_voltage_V   = 230U;
+
+	cfg->loss_pct   = 0U;
+	cfg->latency_ms = 0U;
+	cfg->jitter_ms  = 0U;
+	cfg->seed       = 0x9E3779B9U ^ (n * 2654435761U);
+}
+
+void tbcm_360_3000_he_sim_init(struct tbcm_360_3000_he_sim *self,
+			       const struct tbcm_360_3000_he_sim_config *cfg)
+{
+	uint8_t i;
+
+	self->cfg     = *cfg;
+	self->time_ms = 0U;
+	self->rng     = (cfg->seed != 0U) ? cfg->seed : 1U;
+
+	self->queried        = false;
+	self->query_timer_ms = 0U;
+
+	/* Spread broadcasts of different devices over the period */
+	self->serial_no_timer_ms = (cfg->serial_no_period_ms > 0U) ?
+			(_tbcm_360_3000_he_sim_random(self) %
+			 cfg->serial_no_period_ms) : 0U;
+
+	for (i = 0U; i < 3U; i++) {
+		self->data_timer_ms[i] = 0U;
+	}
+
+	self->enabled        = false;
+	self->set_voltage_dV = 0U;
+	self->set_current_dA = 0U;
+	self->out_voltage_mV = 0U;
+	self->out_current_dA = 0U;
+
+	self->tx_head  = 0U;
+	self->tx_count = 0U;
+
+	self->rx_frames    = 0U;
+	self->rx_lost      = 0U;
+	self->tx_frames    = 0U;
+	self->tx_lost      = 0U;
+	self->tx_overflows = 0U;
+	self->settings     = 0U;
+}
+
+/* Frame from host. Frames not addressed to this device are ignored */
+void tbcm_360_3000_he_sim_write_frame(struct tbcm_360_3000_he_sim *self,
+			       const struct tbcm_360_3000_he_dri_frame *frame)
+{
+	const uint8_t *data = frame->data;
+
+	bool query = (frame->id == 0x351U) && (frame->len == 6U) &&
+		     (memcmp(data, self->cfg.serial_no, 6U) == 0);
+	bool settings = (frame->id == 0x352U) && (frame->len == 8U) &&
+			(data[0] == self->cfg.device_id);
+
+	/* Only frames addressed to us can be lost for us */
+	if ((query || settings) && _tbcm_360_3000_he_sim_lost(self)) {
+		self->rx_lost++;
+	} else if (query) {
+		self->rx_frames++;
+
+		if (!self->queried) {
+			/* Start all data frames right away */
+			self->data_timer_ms[0] = self->cfg.data_period_ms[0];
+			self->data_timer_ms[1] = self->cfg.data_period_ms[1];
+			self->data_timer_ms[2] = self->cfg.data_period_ms[2];
+		}
+
+		self->queried        = true;
+		self->query_timer_ms = 0U;
+	} else if (settings) {
+		self->rx_frames++;
+		self->settings++;
+
+		/* Raw current is dA * 7.5 (see driver) */
+		self->enabled        = data[1] != 0U;
+		self->set_current_dA = (uint16_t)(((((uint32_t)data[2] << 8U) |
+						    data[3]) * 2U) / 15U);
+		self->set_voltage_dV = (uint16_t)(((uint16_t)data[4] << 8U) |
+						  data[5]);
+	} else {}
+}
+
+/* Frame to host. Returns false if nothing is due yet */
+bool tbcm_360_3000_he_sim_read_frame(struct tbcm_360_3000_he_sim *self,
+				     struct tbcm_360_3000_he_dri_frame *frame)
+{
+	bool has_frame = (self->tx_count > 0U) &&
+			 (self->tx[self->tx_head].due_ms <= self->time_ms);
+
+	if (has_frame) {
+		*frame = self->tx[self->tx_head].frame;
+
+		self->tx_head = (uint8_t)((self->tx_head + 1U) %
+					  TBCM_360_3000_HE_SIM_TX_QUEUE_SIZE);
+		self->tx_count--;
+		self->tx_frames++;
+	}
+
+	return has_frame;
+}
+
+void tbcm_360_3000_he_sim_update(struct tbcm_360_3000_he_sim *self,
+				 uint32_t delta_time_ms)
+{
+	uint8_t i;
+
+	self->time_ms += delta_time_ms;
+
+	_tbcm_360_3000_he_sim_output(self, delta_time_ms);
+
+	if (self->queried) {
+		self->query_timer_ms += delta_time_ms;
+
+		if (self->query_timer_ms >= self->cfg.query_timeout_ms) {
+			/* Host is gone, drop setpoints too */
+			self->queried = false;
+			self->enabled = false;
+		}
+	}
+
+	if (!self->queried && (self->cfg.serial_no_period_ms > 0U)) {
+		self->serial_no_timer_ms += delta_time_ms;
+
+		if (self->serial_no_timer_ms >= self->cfg.serial_no_period_ms) {
+			self->serial_no_timer_ms = 0U;
+			_tbcm_360_3000_he_sim_send(self, 0x350U, 6U,
+						   self->cfg.serial_no);
+		}
+	}
+
+	for (i = 0U; self->queried && (i < 3U); i++) {
+		self->data_timer_ms[i] += delta_time_ms;
+
+		if ((self->cfg.data_period_ms[i] > 0U) &&
+		    (self->data_timer_ms[i] >= self->cfg.data_period_ms[i])) {
+			self->data_timer_ms[i] = 0U;
+			_tbcm_360_3000_he_sim_send_data(self, i);
+		}
+	}
+}
+
+/* Output state (what a meter on the output would show) */
+uint16_t tbcm_360_3000_he_sim_get_out_voltage_dV(
+					      struct tbcm_360_3000_he_sim *self)
+{
+	return (uint16_t)(self->out_voltage_mV / 100U);
+}
+
+uint16_t tbcm_360_3000_he_sim_get_out_current_dA(
+					      struct tbcm_360_3000_he_sim *self)
+{
+	return self->out_current_dA;
+}
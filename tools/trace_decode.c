@@ -0,0 +1,87 @@
+/* Decodes binary trace dump (see tbcm_360_3000_he_dri_trace_dump) into the
+ * same text TBCM_360_3000_HE_DRI_LOG prints.
+ *
+ * Dump is a plain sequence of 16 byte records, as the driver wrote them
+ * (e.g. captured from UART). Trailing partial record is reported.
+ *
+ * Usage: trace_decode [dump] (reads stdin without arguments)
+ *
+ * Build: gcc trace_decode.c -std=c89 -pedantic -o trace_decode
+ */
+#include <stdio.h>
+
+#include "trace_format.h"
+
+static void decode(const struct tbcm_360_3000_he_dri_trace_record *r)
+{
+	uint8_t i;
+
+	switch (r->type) {
+	case TBCM_360_3000_HE_DRI_TRACE_RX:
+	case TBCM_360_3000_HE_DRI_TRACE_TX:
+		printf("t=%10u: FRAME(%s), ID:%Xh, LEN:%u, DATA: ",
+		       (unsigned)r->time_ms,
+		       (r->type == TBCM_360_3000_HE_DRI_TRACE_RX) ? "RX" : "TX",
+		       (unsigned)r->id, (unsigned)r->len);
+
+		for (i = 0U; (i < r->len) && (i < 8U); i++) {
+			printf("%02X ", r->data[i]);
+		}
+
+		printf("\n");
+		break;
+
+	case TBCM_360_3000_HE_DRI_TRACE_EVENT:
+		printf("t=%10u: %s", (unsigned)r->time_ms,
+		       tbcm_360_3000_he_trace_event_name(r->id));
+
+		if (r->len == 4U) {
+			printf(" at line %i", (int)(int32_t)
+			       tbcm_360_3000_he_trace_data_u32(r));
+		}
+
+		printf("\n");
+		break;
+
+	case TBCM_360_3000_HE_DRI_TRACE_STATE:
+		printf("t=%10u: STATE %s, READER %s\n", (unsigned)r->time_ms,
+		       tbcm_360_3000_he_trace_state_name(r->data[0]),
+		       tbcm_360_3000_he_trace_reader_state_name(r->data[1]));
+		break;
+
+	case TBCM_360_3000_HE_DRI_TRACE_LOST:
+		printf("t=%10u: TRACE LOST %u records\n", (unsigned)r->time_ms,
+		       (unsigned)tbcm_360_3000_he_trace_data_u32(r));
+		break;
+
+	default:
+		printf("t=%10u: UNKNOWN RECORD TYPE %u\n",
+		       (unsigned)r->time_ms, (unsigned)r->type);
+		break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct tbcm_360_3000_he_dri_trace_record record;
+	FILE *in = stdin;
+
+	if (argc > 1) {
+		in = fopen(argv[1], "rb");
+
+		if (in == NULL) {
+			perror(argv[1]);
+			return 1;
+		}
+	}
+
+	while (tbcm_360_3000_he_trace_read(in, &record)) {
+		decode(&record);
+	}
+
+	if (in != stdin) {
+		(void)fclose(in);
+	}
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/* Converts binary trace dumps (see tbcm_360_3000_he_dri_trace_dump) into
+ * Chrome trace event JSON, to be opened in chrome://tracing or Perfetto.
+ *
+ * Every dump is one driver instance and shows up as its own process with
+ * tracks for driver state, reader state (spans), events and frames
+ * (instants). Time axis is driver uptime, so dumps of instances that were
+ * updated together line up.
+ *
+ * Driver has to be built with TBCM_360_3000_HE_DRI_TRACE_SIZE > 0, state
+ * spans are cut where the ring was overwritten (TRACE LOST instant).
+ *
+ * Usage: trace_export <dump> [dump...] > trace.json
+ *
+ * Build: gcc trace_export.c -std=c89 -pedantic -o trace_export
+ */
+#include <stdio.h>
+
+#include "trace_format.h"
+
+/* Tracks of an instance */
+#define TRACK_STATE  1U
+#define TRACK_READER 2U
+#define TRACK_EVENTS 3U
+#define TRACK_FRAMES 4U
+
+/* Event names without the common prefix */
+#define EVENT_PREFIX_LEN (sizeof("TBCM_360_3000_HE_DRI_EVENT_") - 1U)
+
+/* State span that is still open */
+struct span {
+	bool     open;
+	uint8_t  state;
+	uint32_t start_ms;
+};
+
+static bool first = true;
+
+/* Start next trace event object */
+static void begin(const char *ph, unsigned pid, unsigned tid,
+		  uint32_t time_ms)
+{
+	printf("%s\n{\"ph\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%lu",
+	       first ? "" : ",", ph, pid, tid, (unsigned long)time_ms * 1000UL);
+	first = false;
+}
+
+static void print_string(const char *s)
+{
+	putchar('"');
+
+	for (; *s != '\0'; s++) {
+		if ((*s == '"') || (*s == '\\')) {
+			putchar('\\');
+		}
+
+		putchar(*s);
+	}
+
+	putchar('"');
+}
+
+static void metadata(unsigned pid, unsigned tid, const char *what,
+		     const char *name)
+{
+	begin("M", pid, tid, 0U);
+	printf(",\"name\":\"%s\",\"args\":{\"name\":", what);
+	print_string(name);
+	printf("}}");
+}
+
+static void close_span(unsigned pid, unsigned tid, struct span *span,
+		       const char *name, uint32_t time_ms)
+{
+	if (span->open) {
+		begin("X", pid, tid, span->start_ms);
+		printf(",\"dur\":%lu,\"name\":\"%s\"}",
+		       (unsigned long)(time_ms - span->start_ms) * 1000UL,
+		       name);
+		span->open = false;
+	}
+}
+
+static void next_span(unsigned pid, unsigned tid, struct span *span,
+		      const char *name, uint8_t state, uint32_t time_ms)
+{
+	if (!span->open || (span->state != state)) {
+		close_span(pid, tid, span, name, time_ms);
+
+		span->open     = true;
+		span->state    = state;
+		span->start_ms = time_ms;
+	}
+}
+
+static void instant(unsigned pid, unsigned tid, uint32_t time_ms,
+		    const char *name)
+{
+	begin("i", pid, tid, time_ms);
+	printf(",\"s\":\"t\",\"name\":\"%s\"", name);
+}
+
+static void export_dump(FILE *in, unsigned pid)
+{
+	struct tbcm_360_3000_he_dri_trace_record r;
+	struct span state  = {false, 0U, 0U};
+	struct span reader = {false, 0U, 0U};
+	uint32_t last_ms = 0U;
+	char     name[16];
+	uint8_t  i;
+
+	while (tbcm_360_3000_he_trace_read(in, &r)) {
+		last_ms = r.time_ms;
+
+		switch (r.type) {
+		case TBCM_360_3000_HE_DRI_TRACE_RX:
+		case TBCM_360_3000_HE_DRI_TRACE_TX:
+			sprintf(name, "%s %Xh",
+				(r.type == TBCM_360_3000_HE_DRI_TRACE_RX) ?
+				"RX" : "TX", (unsigned)r.id);
+			instant(pid, TRACK_FRAMES, r.time_ms, name);
+			printf(",\"args\":{\"len\":%u,\"data\":\"",
+			       (unsigned)r.len);
+
+			for (i = 0U; (i < r.len) && (i < 8U); i++) {
+				printf("%s%02X", (i > 0U) ? " " : "",
+				       r.data[i]);
+			}
+
+			printf("\"}}");
+			break;
+
+		case TBCM_360_3000_HE_DRI_TRACE_EVENT:
+			instant(pid, TRACK_EVENTS, r.time_ms,
+				tbcm_360_3000_he_trace_event_name(r.id) +
+				EVENT_PREFIX_LEN);
+
+			if (r.len == 4U) {
+				printf(",\"args\":{\"line\":%i}", (int)(int32_t)
+				       tbcm_360_3000_he_trace_data_u32(&r));
+			}
+
+			printf("}");
+			break;
+
+		case TBCM_360_3000_HE_DRI_TRACE_STATE:
+			next_span(pid, TRACK_STATE, &state,
+				  tbcm_360_3000_he_trace_state_name(
+								 state.state),
+				  r.data[0], r.time_ms);
+			next_span(pid, TRACK_READER, &reader,
+				  tbcm_360_3000_he_trace_reader_state_name(
+							      reader.state),
+				  r.data[1], r.time_ms);
+			break;
+
+		case TBCM_360_3000_HE_DRI_TRACE_LOST:
+			/* States in between are unknown */
+			close_span(pid, TRACK_STATE, &state,
+				   tbcm_360_3000_he_trace_state_name(
+							       state.state),
+				   r.time_ms);
+			close_span(pid, TRACK_READER, &reader,
+				   tbcm_360_3000_he_trace_reader_state_name(
+							      reader.state),
+				   r.time_ms);
+
+			instant(pid, TRACK_EVENTS, r.time_ms, "TRACE LOST");
+			printf(",\"args\":{\"records\":%lu}}", (unsigned long)
+			       tbcm_360_3000_he_trace_data_u32(&r));
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	close_span(pid, TRACK_STATE, &state,
+		   tbcm_360_3000_he_trace_state_name(state.state), last_ms);
+	close_span(pid, TRACK_READER, &reader,
+		   tbcm_360_3000_he_trace_reader_state_name(reader.state),
+		   last_ms);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in;
+	int   result = 0;
+	int   i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dump> [dump...]\n", argv[0]);
+		return 2;
+	}
+
+	printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (i = 1; i < argc; i++) {
+		in = fopen(argv[i], "rb");
+
+		if (in == NULL) {
+			perror(argv[i]);
+			result = 1;
+			continue;
+		}
+
+		metadata((unsigned)i, 0U, "process_name", argv[i]);
+		metadata((unsigned)i, TRACK_STATE, "thread_name", "state");
+		metadata((unsigned)i, TRACK_READER, "thread_name", "reader");
+		metadata((unsigned)i, TRACK_EVENTS, "thread_name", "events");
+		metadata((unsigned)i, TRACK_FRAMES, "thread_name", "frames");
+
+		export_dump(in, (unsigned)i);
+		(void)fclose(in);
+	}
+
+	printf("\n]}\n");
+
+	return result;
+}
@@ -0,0 +1,91 @@
+/** Reading of binary trace dumps (see tbcm_360_3000_he_dri_trace_dump),
+ * shared by trace_decode and trace_export.
+ *
+ * Records are read back into struct tbcm_360_3000_he_dri_trace_record,
+ * so tools do not depend on byte order of the host.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#include "../tbcm_360_3000_he_dri.h"
+
+/* Read next record. Returns false at the end of dump, trailing partial
+ * record is reported to stderr */
+bool tbcm_360_3000_he_trace_read(FILE *in,
+			       struct tbcm_360_3000_he_dri_trace_record *record)
+{
+	uint8_t buf[TBCM_360_3000_HE_DRI_TRACE_RECORD_SIZE];
+	size_t  n = fread(buf, 1U, sizeof(buf), in);
+
+	if (n == sizeof(buf)) {
+		record->time_ms = (uint32_t)buf[0] | ((uint32_t)buf[1] << 8U) |
+				  ((uint32_t)buf[2] << 16U) |
+				  ((uint32_t)buf[3] << 24U);
+		record->id      = (uint16_t)(buf[4] | (buf[5] << 8U));
+		record->type    = buf[6];
+		record->len     = buf[7];
+		(void)memcpy(record->data, &buf[8], 8U);
+	} else if (n > 0U) {
+		fprintf(stderr, "trailing %u bytes ignored\n", (unsigned)n);
+	} else {}
+
+	return n == sizeof(buf);
+}
+
+/* 32 bit value in data (fault line, number of lost records) */
+uint32_t tbcm_360_3000_he_trace_data_u32(
+			 const struct tbcm_360_3000_he_dri_trace_record *record)
+{
+	return (uint32_t)record->data[0] | ((uint32_t)record->data[1] << 8U) |
+	       ((uint32_t)record->data[2] << 16U) |
+	       ((uint32_t)record->data[3] << 24U);
+}
+
+const char *tbcm_360_3000_he_trace_event_name(uint16_t event)
+{
+	static const char *names[] = {
+		"TBCM_360_3000_HE_DRI_EVENT_NONE",
+		"TBCM_360_3000_HE_DRI_EVENT_SERIAL_NO",
+		"TBCM_360_3000_HE_DRI_EVENT_DEVICE_ID",
+		"TBCM_360_3000_HE_DRI_EVENT_ESTABLISHED",
+		"TBCM_360_3000_HE_DRI_EVENT_FAULT",
+		"TBCM_360_3000_HE_DRI_EVENT_TELEMETRY",
+		"TBCM_360_3000_HE_DRI_EVENT_LINK_DEGRADED"};
+
+	return (event < (sizeof(names) / sizeof(names[0]))) ?
+	       names[event] : "UNKNOWN_EVENT";
+}
+
+const char *tbcm_360_3000_he_trace_state_name(uint8_t state)
+{
+	static const char *names[] = {
+		"LISTEN_DEVICES",
+		"QUERY_DEVICE",
+		"ACK_ID",
+		"ESTABLISHED",
+		"RECONNECT"};
+	const char *name = "UNKNOWN_STATE";
+
+	if (state == (uint8_t)TBCM_360_3000_HE_DRI_STATE_FAULT) {
+		name = "FAULT";
+	} else if (state < (sizeof(names) / sizeof(names[0]))) {
+		name = names[state];
+	} else {}
+
+	return name;
+}
+
+const char *tbcm_360_3000_he_trace_reader_state_name(uint8_t state)
+{
+	static const char *names[] = {
+		"SERIAL_NO",
+		"DEVICE_ID",
+		"DATA",
+		"DONE",
+		"TIMEOUT"};
+
+	return (state < (sizeof(names) / sizeof(names[0]))) ?
+	       names[state] : "UNKNOWN_STATE";
+}